@@ -3,7 +3,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* A block device. */
 struct block {
@@ -26,6 +26,9 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
+/* Cache of struct blocks, created by the first block_register(). */
+static struct kmem_cache *block_cache;
+
 static struct block *list_elem_to_block(struct list_elem *);
 
 /* Returns a human-readable name for the given block device
@@ -179,7 +182,11 @@ block_register(const char *name, enum block_type type,
                const char *extra_info, block_sector_t size,
                const struct block_operations *ops, void *aux)
 {
-    struct block *block = malloc(sizeof *block);
+    struct block *block;
+
+    if (block_cache == NULL)
+        block_cache = kmem_cache_create("block", sizeof *block, 0, NULL);
+    block = block_cache != NULL ? kmem_cache_alloc(block_cache) : NULL;
     if (block == NULL)
         PANIC("Failed to allocate memory for block device descriptor");
 
@@ -4,7 +4,11 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/heapprof.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 
 
@@ -109,6 +113,10 @@ print_stats(void)
 {
     timer_print_stats();
     thread_print_stats();
+    palloc_print_stats();
+    malloc_print_stats();
+    slab_print_stats();
+    heapprof_dump();
 
     console_print_stats();
     kbd_print_stats();
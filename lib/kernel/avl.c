@@ -0,0 +1,235 @@
+/* Balanced binary search tree.
+
+   See avl.h for basic information. */
+
+#include "avl.h"
+#include "../debug.h"
+
+static struct avl_elem *insert_elem(struct avl *, struct avl_elem *node,
+                                    struct avl_elem *);
+static struct avl_elem *delete_elem(struct avl *, struct avl_elem *node,
+                                    struct avl_elem *);
+static struct avl_elem *delete_min(struct avl_elem *node,
+                                   struct avl_elem **min);
+static struct avl_elem *rebalance(struct avl_elem *);
+
+/* Initializes tree T to compare elements using LESS, given
+   auxiliary data AUX. */
+void avl_init(struct avl *t, avl_less_func *less, void *aux)
+{
+    ASSERT(t != NULL);
+    ASSERT(less != NULL);
+
+    t->root = NULL;
+    t->elem_cnt = 0;
+    t->less = less;
+    t->aux = aux;
+}
+
+/* Inserts NEW into tree T.  No element equal to NEW may already
+   be in T. */
+void avl_insert(struct avl *t, struct avl_elem *new)
+{
+    ASSERT(t != NULL);
+    ASSERT(new != NULL);
+
+    new->left = new->right = NULL;
+    new->height = 1;
+    t->root = insert_elem(t, t->root, new);
+    t->elem_cnt++;
+}
+
+/* Removes E, which must be in tree T, from T. */
+void avl_delete(struct avl *t, struct avl_elem *e)
+{
+    ASSERT(t != NULL);
+    ASSERT(e != NULL);
+
+    t->root = delete_elem(t, t->root, e);
+    t->elem_cnt--;
+}
+
+/* Returns the least element in tree T that is not less than KEY,
+   or a null pointer if there is none.  KEY need not be in T. */
+struct avl_elem *
+avl_lower_bound(const struct avl *t, const struct avl_elem *key)
+{
+    struct avl_elem *node = t->root;
+    struct avl_elem *found = NULL;
+
+    while (node != NULL)
+        if (t->less(node, key, t->aux))
+            node = node->right;
+        else {
+            found = node;
+            node = node->left;
+        }
+    return found;
+}
+
+/* Returns the least element in tree T that is greater than E, or
+   a null pointer if there is none.  E need not be in T.  Takes
+   O(log N) time, so walking a whole tree this way takes
+   O(N log N). */
+struct avl_elem *
+avl_next(const struct avl *t, const struct avl_elem *e)
+{
+    struct avl_elem *node = t->root;
+    struct avl_elem *found = NULL;
+
+    while (node != NULL)
+        if (t->less(e, node, t->aux)) {
+            found = node;
+            node = node->left;
+        } else
+            node = node->right;
+    return found;
+}
+
+/* Returns the greatest element in tree T, or a null pointer if T
+   is empty. */
+struct avl_elem *
+avl_max(const struct avl *t)
+{
+    struct avl_elem *node = t->root;
+
+    if (node != NULL)
+        while (node->right != NULL)
+            node = node->right;
+    return node;
+}
+
+/* Returns the number of elements in T. */
+size_t
+avl_size(const struct avl *t)
+{
+    return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool avl_empty(const struct avl *t)
+{
+    return t->elem_cnt == 0;
+}
+
+/* Returns the height of the subtree rooted at NODE. */
+static inline int
+height(const struct avl_elem *node)
+{
+    return node != NULL ? node->height : 0;
+}
+
+/* Recomputes NODE's height from its children's. */
+static inline void
+update_height(struct avl_elem *node)
+{
+    int l = height(node->left), r = height(node->right);
+    node->height = (l > r ? l : r) + 1;
+}
+
+/* Rotates the subtree rooted at NODE to the right and returns
+   the new root. */
+static struct avl_elem *
+rotate_right(struct avl_elem *node)
+{
+    struct avl_elem *root = node->left;
+
+    node->left = root->right;
+    root->right = node;
+    update_height(node);
+    update_height(root);
+    return root;
+}
+
+/* Rotates the subtree rooted at NODE to the left and returns the
+   new root. */
+static struct avl_elem *
+rotate_left(struct avl_elem *node)
+{
+    struct avl_elem *root = node->right;
+
+    node->right = root->left;
+    root->left = node;
+    update_height(node);
+    update_height(root);
+    return root;
+}
+
+/* Restores the balance of the subtree rooted at NODE, whose
+   children are balanced and differ in height by at most two,
+   and returns the new root. */
+static struct avl_elem *
+rebalance(struct avl_elem *node)
+{
+    int balance = height(node->left) - height(node->right);
+
+    if (balance > 1) {
+        if (height(node->left->left) < height(node->left->right))
+            node->left = rotate_left(node->left);
+        return rotate_right(node);
+    } else if (balance < -1) {
+        if (height(node->right->right) < height(node->right->left))
+            node->right = rotate_right(node->right);
+        return rotate_left(node);
+    }
+
+    update_height(node);
+    return node;
+}
+
+/* Inserts NEW into the subtree of T rooted at NODE and returns
+   the subtree's new root. */
+static struct avl_elem *
+insert_elem(struct avl *t, struct avl_elem *node, struct avl_elem *new)
+{
+    if (node == NULL)
+        return new;
+    if (t->less(new, node, t->aux))
+        node->left = insert_elem(t, node->left, new);
+    else
+        node->right = insert_elem(t, node->right, new);
+    return rebalance(node);
+}
+
+/* Removes E from the subtree of T rooted at NODE and returns the
+   subtree's new root. */
+static struct avl_elem *
+delete_elem(struct avl *t, struct avl_elem *node, struct avl_elem *e)
+{
+    ASSERT(node != NULL);
+
+    if (node == e) {
+        struct avl_elem *min;
+
+        if (node->left == NULL)
+            return node->right;
+        if (node->right == NULL)
+            return node->left;
+
+        /* Replace NODE by the least element of its right subtree. */
+        min = NULL;
+        node->right = delete_min(node->right, &min);
+        min->left = node->left;
+        min->right = node->right;
+        return rebalance(min);
+    }
+
+    if (t->less(e, node, t->aux))
+        node->left = delete_elem(t, node->left, e);
+    else
+        node->right = delete_elem(t, node->right, e);
+    return rebalance(node);
+}
+
+/* Removes the least element from the subtree rooted at NODE,
+   storing it into *MIN, and returns the subtree's new root. */
+static struct avl_elem *
+delete_min(struct avl_elem *node, struct avl_elem **min)
+{
+    if (node->left == NULL) {
+        *min = node;
+        return node->right;
+    }
+    node->left = delete_min(node->left, min);
+    return rebalance(node);
+}
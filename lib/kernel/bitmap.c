@@ -23,10 +23,20 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A bitmap may also carry a two-level summary, attached with
+   bitmap_attach_summary().  Bit K of FULL is set when element K
+   of BITS has all of its bits set, and bit K of EMPTY when it
+   has none of them set.  Scans use the summary to step over
+   ELEM_BITS elements, that is ELEM_BITS * ELEM_BITS bits, at a
+   time.  Updating a bit and its summary together is not atomic,
+   so callers of a summarized bitmap must serialize updates. */
 struct bitmap {
-    size_t bit_cnt;  /* Number of bits. */
-    elem_type *bits; /* Elements that represent bits. */
+    size_t bit_cnt;   /* Number of bits. */
+    elem_type *bits;  /* Elements that represent bits. */
+    elem_type *full;  /* Summary of all-ones elements, or null. */
+    elem_type *empty; /* Summary of all-zeros elements, or null. */
 };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +78,108 @@ last_mask(const struct bitmap *b)
     return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type)-1;
 }
 
+/* Returns an elem_type in which the bits for bit offsets LO
+   through HI - 1 within an element are turned on, where
+   0 <= LO < HI <= ELEM_BITS. */
+static inline elem_type
+range_mask(size_t lo, size_t hi)
+{
+    elem_type high = hi < ELEM_BITS ? ((elem_type)1 << hi) - 1 : (elem_type)-1;
+    return high & ((elem_type)-1 << lo);
+}
+
+/* Returns the number of bits in E that are turned on. */
+static inline size_t
+elem_popcount(elem_type e)
+{
+    /* Sum adjacent bits, then pairs, then nibbles, and finally add
+     up all the bytes with a multiply.  Works for any width of
+     elem_type up to 64 bits. */
+    e = e - ((e >> 1) & (elem_type)0x5555555555555555ULL);
+    e = (e & (elem_type)0x3333333333333333ULL)
+        + ((e >> 2) & (elem_type)0x3333333333333333ULL);
+    e = (e + (e >> 4)) & (elem_type)0x0f0f0f0f0f0f0f0fULL;
+    return (elem_type)(e * (elem_type)0x0101010101010101ULL) >> (ELEM_BITS - 8);
+}
+
+/* Recomputes the summary bits for element IDX of B, which must
+   have a summary. */
+static void
+summary_update(struct bitmap *b, size_t idx)
+{
+    elem_type valid = idx == elem_cnt(b->bit_cnt) - 1 ? last_mask(b) : (elem_type)-1;
+    elem_type e = b->bits[idx] & valid;
+
+    if (e == valid)
+        b->full[elem_idx(idx)] |= bit_mask(idx);
+    else
+        b->full[elem_idx(idx)] &= ~bit_mask(idx);
+    if (e == 0)
+        b->empty[elem_idx(idx)] |= bit_mask(idx);
+    else
+        b->empty[elem_idx(idx)] &= ~bit_mask(idx);
+}
+
+/* Returns the index of the first element of B at or after IDX
+   that may hold a bit set to VALUE according to B's summary, or
+   the number of elements in B if there is none. */
+static size_t
+summary_next(const struct bitmap *b, size_t idx, bool value)
+{
+    const elem_type *summary = value ? b->empty : b->full;
+    size_t cnt = elem_cnt(b->bit_cnt);
+    size_t last = elem_cnt(cnt);
+    size_t sum_idx = elem_idx(idx);
+    elem_type e;
+
+    if (idx >= cnt)
+        return cnt;
+
+    e = ~summary[sum_idx] & ((elem_type)-1 << (idx % ELEM_BITS));
+    while (e == 0) {
+        if (++sum_idx >= last)
+            return cnt;
+        e = ~summary[sum_idx];
+    }
+
+    idx = sum_idx * ELEM_BITS + __builtin_ctzl(e);
+    return idx < cnt ? idx : cnt;
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is no such
+   bit.  Whole elements that hold no such bit are skipped in one
+   step. */
+static size_t
+find_next(const struct bitmap *b, size_t start, size_t end, bool value)
+{
+    elem_type flip = value ? 0 : (elem_type)-1;
+    size_t last = elem_idx(end - 1);
+    size_t idx = elem_idx(start);
+    elem_type e;
+    size_t bit_idx;
+
+    if (start >= end)
+        return end;
+
+    e = (b->bits[idx] ^ flip) & ((elem_type)-1 << (start % ELEM_BITS));
+    while (e == 0) {
+        if (++idx > last)
+            return end;
+        if (b->full != NULL) {
+            idx = summary_next(b, idx, value);
+            if (idx > last)
+                return end;
+        }
+        e = b->bits[idx] ^ flip;
+    }
+
+    /* Bits at or past END, including bits past the end of B in
+     its last element, are ignored here. */
+    bit_idx = idx * ELEM_BITS + __builtin_ctzl(e);
+    return bit_idx < end ? bit_idx : end;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -81,6 +193,7 @@ bitmap_create(size_t bit_cnt)
     if (b != NULL) {
         b->bit_cnt = bit_cnt;
         b->bits = malloc(byte_cnt(bit_cnt));
+        b->full = b->empty = NULL;
         if (b->bits != NULL || bit_cnt == 0) {
             bitmap_set_all(b, false);
             return b;
@@ -102,6 +215,7 @@ bitmap_create_in_buf(size_t bit_cnt, void *block, size_t block_size UNUSED)
 
     b->bit_cnt = bit_cnt;
     b->bits = (elem_type *)(b + 1);
+    b->full = b->empty = NULL;
     bitmap_set_all(b, false);
     return b;
 }
@@ -114,6 +228,36 @@ bitmap_buf_size(size_t bit_cnt)
     return sizeof(struct bitmap) + byte_cnt(bit_cnt);
 }
 
+/* Returns the number of bytes required for the summary of a
+   bitmap with BIT_CNT bits (for use with
+   bitmap_attach_summary()). */
+size_t
+bitmap_summary_buf_size(size_t bit_cnt)
+{
+    return 2 * byte_cnt(elem_cnt(bit_cnt));
+}
+
+/* Gives B a two-level summary stored in the BLOCK_SIZE bytes of
+   storage preallocated at BLOCK, and fills it in from B's
+   current contents.  BLOCK_SIZE must be at least
+   bitmap_summary_buf_size(bitmap_size(B)).  The storage is not
+   freed by bitmap_destroy(). */
+void bitmap_attach_summary(struct bitmap *b, void *block, size_t block_size UNUSED)
+{
+    size_t sum_cnt = elem_cnt(elem_cnt(b->bit_cnt));
+    size_t idx;
+
+    ASSERT(b != NULL);
+    ASSERT(block_size >= bitmap_summary_buf_size(b->bit_cnt));
+
+    b->full = block;
+    b->empty = b->full + sum_cnt;
+    for (idx = 0; idx < sum_cnt; idx++)
+        b->full[idx] = b->empty[idx] = 0;
+    for (idx = 0; idx < elem_cnt(b->bit_cnt); idx++)
+        summary_update(b, idx);
+}
+
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by
    bitmap_create_preallocated(). */
@@ -157,6 +301,8 @@ void bitmap_mark(struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
     asm("orl %1, %0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+    if (b->full != NULL)
+        summary_update(b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -169,6 +315,8 @@ void bitmap_reset(struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
     asm("andl %1, %0" : "=m"(b->bits[idx]) : "r"(~mask) : "cc");
+    if (b->full != NULL)
+        summary_update(b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -183,6 +331,8 @@ void bitmap_flip(struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
     asm("xorl %1, %0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+    if (b->full != NULL)
+        summary_update(b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -203,17 +353,32 @@ void bitmap_set_all(struct bitmap *b, bool value)
     bitmap_set_multiple(b, 0, bitmap_size(b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated in a single atomic instruction. */
 void bitmap_set_multiple(struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-    size_t i;
+    size_t end = start + cnt;
 
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
     ASSERT(start + cnt <= b->bit_cnt);
 
-    for (i = 0; i < cnt; i++)
-        bitmap_set(b, start + i, value);
+    while (start < end) {
+        size_t idx = elem_idx(start);
+        size_t lo = start % ELEM_BITS;
+        size_t hi = end - idx * ELEM_BITS < ELEM_BITS ? end - idx * ELEM_BITS : ELEM_BITS;
+        elem_type mask = range_mask(lo, hi);
+
+        /* Same as bitmap_mark() and bitmap_reset(), but for every
+         bit in MASK at once. */
+        if (value)
+            asm("orl %1, %0" : "+m"(b->bits[idx]) : "r"(mask) : "cc");
+        else
+            asm("andl %1, %0" : "+m"(b->bits[idx]) : "r"(~mask) : "cc");
+        if (b->full != NULL)
+            summary_update(b, idx);
+        start += hi - lo;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -221,33 +386,33 @@ void bitmap_set_multiple(struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-    size_t i, value_cnt;
+    size_t end = start + cnt;
+    size_t one_cnt = 0;
 
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
     ASSERT(start + cnt <= b->bit_cnt);
 
-    value_cnt = 0;
-    for (i = 0; i < cnt; i++)
-        if (bitmap_test(b, start + i) == value)
-            value_cnt++;
-    return value_cnt;
+    while (start < end) {
+        size_t idx = elem_idx(start);
+        size_t lo = start % ELEM_BITS;
+        size_t hi = end - idx * ELEM_BITS < ELEM_BITS ? end - idx * ELEM_BITS : ELEM_BITS;
+
+        one_cnt += elem_popcount(b->bits[idx] & range_mask(lo, hi));
+        start += hi - lo;
+    }
+    return value ? one_cnt : cnt - one_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-    size_t i;
-
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
     ASSERT(start + cnt <= b->bit_cnt);
 
-    for (i = 0; i < cnt; i++)
-        if (bitmap_test(b, start + i) == value)
-            return true;
-    return false;
+    return find_next(b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -283,14 +448,24 @@ bitmap_scan(const struct bitmap *b, size_t start, size_t cnt, bool value)
     ASSERT(b != NULL);
     ASSERT(start <= b->bit_cnt);
 
-    if (cnt <= b->bit_cnt) {
-        size_t last = b->bit_cnt - cnt;
-        size_t i;
-        for (i = start; i <= last; i++)
-            if (!bitmap_contains(b, i, cnt, !value))
-                return i;
+    if (cnt > b->bit_cnt)
+        return BITMAP_ERROR;
+    if (cnt == 0)
+        return start;
+
+    /* Hop from each run of VALUE bits to the next, skipping whole
+     elements at a time, until one is long enough. */
+    for (;;) {
+        size_t run_start = find_next(b, start, b->bit_cnt, value);
+        size_t run_end;
+
+        if (b->bit_cnt - run_start < cnt)
+            return BITMAP_ERROR;
+        run_end = find_next(b, run_start, run_start + cnt, !value);
+        if (run_end - run_start >= cnt)
+            return run_start;
+        start = run_end;
     }
-    return BITMAP_ERROR;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -328,6 +503,8 @@ bool bitmap_read(struct bitmap *b, struct file *file)
         off_t size = byte_cnt(b->bit_cnt);
         success = file_read_at(file, b->bits, size, 0) == size;
         b->bits[elem_cnt(b->bit_cnt) - 1] &= last_mask(b);
+        if (b->full != NULL)
+            bitmap_attach_summary(b, b->full, bitmap_summary_buf_size(b->bit_cnt));
     }
     return success;
 }
@@ -13,6 +13,10 @@ struct bitmap *bitmap_create_in_buf(size_t bit_cnt, void *, size_t byte_cnt);
 size_t bitmap_buf_size(size_t bit_cnt);
 void bitmap_destroy(struct bitmap *);
 
+/* Optional two-level summary, for faster scans. */
+size_t bitmap_summary_buf_size(size_t bit_cnt);
+void bitmap_attach_summary(struct bitmap *, void *, size_t byte_cnt);
+
 /* Bitmap size. */
 size_t bitmap_size(const struct bitmap *);
 
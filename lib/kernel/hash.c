@@ -359,6 +359,38 @@ rehash(struct hash *h)
     if (new_bucket_cnt == old_bucket_cnt)
         return;
 
+    /* If the current bucket array has room for the new buckets,
+     as when shrinking, or growing into slack that malloc() left
+     at its end, rehash in place. */
+    if (sizeof *old_buckets * new_bucket_cnt
+        <= malloc_usable_size(old_buckets)) {
+        for (i = old_bucket_cnt; i < new_bucket_cnt; i++)
+            list_init(&old_buckets[i]);
+        h->bucket_cnt = new_bucket_cnt;
+
+        /* Move each element whose bucket changed.  Growing only
+         moves elements to buckets past OLD_BUCKET_CNT, and
+         shrinking only to buckets already visited, so no element
+         is looked at twice. */
+        for (i = 0; i < old_bucket_cnt; i++) {
+            struct list *old_bucket = &old_buckets[i];
+            struct list_elem *elem, *next;
+            struct list *new_bucket;
+
+            for (elem = list_begin(old_bucket);
+                 elem != list_end(old_bucket); elem = next) {
+                new_bucket = find_bucket(h,
+                                         list_elem_to_hash_elem(elem));
+                next = list_next(elem);
+                if (new_bucket != old_bucket) {
+                    list_remove(elem);
+                    list_push_front(new_bucket, elem);
+                }
+            }
+        }
+        return;
+    }
+
     /* Allocate new buckets and initialize them as empty. */
     new_buckets = malloc(sizeof *new_buckets * new_bucket_cnt);
     if (new_buckets == NULL) {
@@ -0,0 +1,49 @@
+/* Checks that palloc_get_aligned() returns aligned pages in
+   every palloc mode. */
+
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include <stdio.h>
+
+/* Returns "yes" if PAGES is aligned on ALIGN pages in physical
+   memory, "no" otherwise. */
+static const char *
+is_aligned (void *pages, size_t align) 
+{
+    if (pages == NULL)
+        return "no";
+    return pg_no ((void *) vtop (pages)) % align == 0 ? "yes" : "no";
+}
+
+static void
+try_mode (enum palloc_mode mode, const char *name) 
+{
+    void *a, *b, *c, *d;
+
+    palloc_set_mode (mode);
+
+    /* Knock the next free page out of alignment. */
+    a = palloc_get_multiple (PAL_USER, 3);
+
+    b = palloc_get_aligned (PAL_USER, 16, 16);
+    msg ("%s: 16 pages on a 16-page boundary: %s", name, is_aligned (b, 16));
+    c = palloc_get_aligned (PAL_USER, 1, 8);
+    msg ("%s: 1 page on an 8-page boundary: %s", name, is_aligned (c, 8));
+    d = palloc_get_aligned (PAL_USER, 5, 64);
+    msg ("%s: 5 pages on a 64-page boundary: %s", name, is_aligned (d, 64));
+
+    palloc_free_multiple (a, 3);
+    palloc_free_multiple (b, 16);
+    palloc_free_multiple (c, 1);
+    palloc_free_multiple (d, 5);
+}
+
+void test_aligned (void) 
+{
+    try_mode (PAL_FIRST_FIT, "first fit");
+    try_mode (PAL_NEXT_FIT, "next fit");
+    try_mode (PAL_BEST_FIT, "best fit");
+    try_mode (PAL_BUDDY, "buddy");
+    try_mode (PAL_TLSF, "TLSF");
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aligned) begin
+(aligned) first fit: 16 pages on a 16-page boundary: yes
+(aligned) first fit: 1 page on an 8-page boundary: yes
+(aligned) first fit: 5 pages on a 64-page boundary: yes
+(aligned) next fit: 16 pages on a 16-page boundary: yes
+(aligned) next fit: 1 page on an 8-page boundary: yes
+(aligned) next fit: 5 pages on a 64-page boundary: yes
+(aligned) best fit: 16 pages on a 16-page boundary: yes
+(aligned) best fit: 1 page on an 8-page boundary: yes
+(aligned) best fit: 5 pages on a 64-page boundary: yes
+(aligned) buddy: 16 pages on a 16-page boundary: yes
+(aligned) buddy: 1 page on an 8-page boundary: yes
+(aligned) buddy: 5 pages on a 64-page boundary: yes
+(aligned) TLSF: 16 pages on a 16-page boundary: yes
+(aligned) TLSF: 1 page on an 8-page boundary: yes
+(aligned) TLSF: 5 pages on a 64-page boundary: yes
+(aligned) end
+EOF
+pass;
@@ -0,0 +1,135 @@
+/* Times bitmap_scan(), bitmap_set_multiple() and bitmap_count()
+   on a fragmented 16k-page used_map against straightforward
+   bit-at-a-time versions of the same functions, and checks that
+   both give the same answers.
+
+   The map has a single free page every 37 pages and one free
+   run of 64 pages near its end, so that a scan for the run has
+   to step over every hole first. */
+
+#include <bitmap.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/io.h"
+
+#define PAGE_CNT 16384
+#define RUN_START (PAGE_CNT - 200)
+#define RUN_CNT 64
+#define ITERATIONS 50
+
+/* bitmap_scan() as it used to be: tests every bit of every
+   candidate run. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+    size_t i, j;
+
+    for (i = start; i + cnt <= bitmap_size (b); i++)
+      {
+        for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+                break;
+        if (j == cnt)
+            return i;
+      }
+    return BITMAP_ERROR;
+}
+
+/* bitmap_set_multiple() as it used to be. */
+static void
+slow_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+    size_t i;
+
+    for (i = 0; i < cnt; i++)
+        bitmap_set (b, start + i, value);
+}
+
+/* bitmap_count() as it used to be. */
+static size_t
+slow_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+    size_t i, value_cnt = 0;
+
+    for (i = 0; i < cnt; i++)
+        if (bitmap_test (b, start + i) == value)
+            value_cnt++;
+    return value_cnt;
+}
+
+/* Marks every page of B used, except for the holes and the free
+   run described at the top of this file. */
+static void
+fragment (struct bitmap *b)
+{
+    size_t i;
+
+    bitmap_set_all (b, true);
+    for (i = 0; i < RUN_START; i += 37)
+        bitmap_reset (b, i);
+    bitmap_set_multiple (b, RUN_START, RUN_CNT, false);
+}
+
+/* Prints the cycle counts of the old and new versions of NAME. */
+static void
+report (const char *name, uint64_t slow, uint64_t fast)
+{
+    msg ("%s: %llu cycles bit-at-a-time, %llu cycles word-at-a-time, "
+         "%llux speedup", name, slow / ITERATIONS, fast / ITERATIONS,
+         fast > 0 ? slow / fast : 0);
+}
+
+void
+test_bitmap_bench (void)
+{
+    struct bitmap *b = bitmap_create (PAGE_CNT);
+    uint64_t start, slow, fast;
+    size_t slow_idx = 0, fast_idx = 0;
+    size_t slow_cnt = 0, fast_cnt = 0;
+    int i;
+
+    if (b == NULL)
+        fail ("bitmap_create failed");
+    fragment (b);
+
+    start = rdtsc ();
+    for (i = 0; i < ITERATIONS; i++)
+        slow_idx = slow_scan (b, 0, RUN_CNT, false);
+    slow = rdtsc () - start;
+    start = rdtsc ();
+    for (i = 0; i < ITERATIONS; i++)
+        fast_idx = bitmap_scan (b, 0, RUN_CNT, false);
+    fast = rdtsc () - start;
+    if (slow_idx != RUN_START || fast_idx != RUN_START)
+        fail ("scan found %zu and %zu, expected %d",
+              slow_idx, fast_idx, RUN_START);
+    report ("bitmap_scan", slow, fast);
+
+    start = rdtsc ();
+    for (i = 0; i < ITERATIONS; i++)
+        slow_cnt = slow_count (b, 0, PAGE_CNT, false);
+    slow = rdtsc () - start;
+    start = rdtsc ();
+    for (i = 0; i < ITERATIONS; i++)
+        fast_cnt = bitmap_count (b, 0, PAGE_CNT, false);
+    fast = rdtsc () - start;
+    if (slow_cnt != fast_cnt)
+        fail ("count found %zu and %zu", slow_cnt, fast_cnt);
+    report ("bitmap_count", slow, fast);
+
+    start = rdtsc ();
+    for (i = 0; i < ITERATIONS; i++)
+        slow_set_multiple (b, 1, PAGE_CNT - 2, i % 2 == 0);
+    slow = rdtsc () - start;
+    start = rdtsc ();
+    for (i = 0; i < ITERATIONS; i++)
+        bitmap_set_multiple (b, 1, PAGE_CNT - 2, i % 2 == 0);
+    fast = rdtsc () - start;
+    if (bitmap_count (b, 1, PAGE_CNT - 2, false) != PAGE_CNT - 2)
+        fail ("set_multiple left bits set");
+    report ("bitmap_set_multiple", slow, fast);
+
+    bitmap_destroy (b);
+    pass ();
+}
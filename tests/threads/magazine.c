@@ -0,0 +1,61 @@
+/* Checks that single user pages are recycled through the user
+   pool's magazine without going back to the pool, that
+   short-lived ones go through a magazine of their own, and that
+   pinned ones go through neither.  The idle thread may zero
+   some of the magazine's pages meanwhile, so those count too. */
+
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include <stdio.h>
+
+void test_magazine (void) 
+{
+    struct magazine *mag = &user_pool.mag;
+    struct magazine *short_mag = &user_pool.short_mag;
+    unsigned long long hits, misses;
+    void *a, *b, *c, *d;
+
+    /* Starts with an empty magazine. */
+    palloc_set_mode (PAL_FIRST_FIT);
+
+    misses = mag->get_misses;
+    a = palloc_get_page (PAL_USER);
+    msg ("A refilled the magazine: %s",
+         mag->get_misses == misses + 1 ? "yes" : "no");
+    msg ("A at index %zu", palloc_get_page_index (a));
+
+    hits = mag->get_hits;
+    b = palloc_get_page (PAL_USER);
+    msg ("B came from the magazine: %s",
+         mag->get_hits == hits + 1 ? "yes" : "no");
+    msg ("B at index %zu", palloc_get_page_index (b));
+
+    palloc_free_page (b);
+    c = palloc_get_page (PAL_USER);
+    msg ("C reused B: %s", c == b ? "yes" : "no");
+    msg ("Magazine holds %zu pages", mag->cnt + mag->zeroed_cnt);
+
+    misses = short_mag->get_misses;
+    d = palloc_get_page (PAL_USER | PAL_SHORTLIVED);
+    msg ("Short-lived page refilled its own magazine: %s",
+         short_mag->get_misses == misses + 1 ? "yes" : "no");
+    hits = short_mag->free_hits;
+    palloc_free_page (d);
+    msg ("Short-lived page went back to its own magazine: %s",
+         short_mag->free_hits == hits + 1 ? "yes" : "no");
+
+    hits = mag->free_hits + short_mag->free_hits;
+    misses = mag->free_misses + short_mag->free_misses;
+    d = palloc_get_page (PAL_USER | PAL_PINNED_LONG);
+    palloc_free_page (d);
+    msg ("Pinned page bypassed the magazines: %s",
+         mag->free_hits + short_mag->free_hits == hits
+         && mag->free_misses + short_mag->free_misses == misses
+         ? "yes" : "no");
+
+    palloc_free_page (a);
+    palloc_free_page (c);
+    palloc_set_mode (PAL_FIRST_FIT);
+    msg ("Magazine holds %zu pages after drain",
+         mag->cnt + mag->zeroed_cnt);
+}
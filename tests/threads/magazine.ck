@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(magazine) begin
+(magazine) A refilled the magazine: yes
+(magazine) A at index 0
+(magazine) B came from the magazine: yes
+(magazine) B at index 1
+(magazine) C reused B: yes
+(magazine) Magazine holds 14 pages
+(magazine) Short-lived page refilled its own magazine: yes
+(magazine) Short-lived page went back to its own magazine: yes
+(magazine) Pinned page bypassed the magazines: yes
+(magazine) Magazine holds 0 pages after drain
+(magazine) end
+EOF
+pass;
@@ -0,0 +1,55 @@
+/* Frees a big block and checks that the next request for as many
+   pages gets the same block back from malloc()'s big-block cache,
+   without going to the page allocator, while a request for a
+   different number of pages does not. */
+
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+/* Returns the number of pages in use in the kernel pool. */
+static size_t
+kernel_used (void) 
+{
+    struct palloc_stats st;
+
+    palloc_stats (&kernel_pool, &st);
+    return st.used_pages;
+}
+
+void
+test_malloc_big_cache (void) 
+{
+    struct malloc_stats before, after;
+    void *p, *q;
+    size_t used;
+    int i;
+
+    p = malloc (16 * 1024);
+    if (p == NULL)
+        fail ("malloc failed");
+    free (p);
+
+    malloc_stats (&before);
+    used = kernel_used ();
+    for (i = 0; i < 100; i++)
+      {
+        q = malloc (16 * 1024);
+        if (q == NULL)
+            fail ("malloc failed");
+        if (q != p)
+            fail ("freed block not reused");
+        free (q);
+      }
+    malloc_stats (&after);
+    msg ("Same-size requests served from cache: %s",
+         after.big_cache_hits - before.big_cache_hits == 100 ? "yes" : "no");
+    msg ("Page allocator untouched: %s",
+         kernel_used () == used ? "yes" : "no");
+
+    q = malloc (32 * 1024);
+    if (q == NULL)
+        fail ("malloc failed");
+    msg ("Bigger request got a different block: %s", q != p ? "yes" : "no");
+    free (q);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-big-cache) begin
+(malloc-big-cache) Same-size requests served from cache: yes
+(malloc-big-cache) Page allocator untouched: yes
+(malloc-big-cache) Bigger request got a different block: yes
+(malloc-big-cache) end
+EOF
+pass;
@@ -0,0 +1,102 @@
+/* Checks that malloc() and free() calls paired in one thread are
+   served from the thread's cache, taking a descriptor lock only
+   for the occasional batch, and that a thread's cached blocks go
+   back to their arenas when it exits. */
+
+#include <stdbool.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+#define PAIR_CNT 1000
+#define BLOCK_CNT 100
+
+static thread_func churn_thread;
+static bool thread_alive (tid_t);
+
+void
+test_malloc_cache (void) 
+{
+    struct malloc_stats before, after;
+    tid_t tid;
+    size_t i;
+
+    malloc_stats (&before);
+    for (i = 0; i < PAIR_CNT; i++)
+      {
+        void *p = malloc (32);
+        if (p == NULL)
+            fail ("malloc failed");
+        free (p);
+      }
+    malloc_stats (&after);
+    msg ("Lock taken for fewer than 1 in 100 pairs: %s",
+         (after.lock_acquires - before.lock_acquires) * 100 < PAIR_CNT
+         ? "yes" : "no");
+
+    /* thread_exit() flushes the cache before it takes the thread
+       off the list of all threads, so once the child is gone from
+       that list its blocks are back in their arenas. */
+    malloc_stats (&before);
+    tid = thread_create ("churn", PRI_DEFAULT, churn_thread, NULL);
+    if (tid == TID_ERROR)
+        fail ("thread_create failed");
+    while (thread_alive (tid))
+        thread_yield ();
+    malloc_stats (&after);
+    msg ("Exiting thread's cache flushed: %s",
+         after.cached == before.cached ? "yes" : "no");
+}
+
+/* Allocates and frees a batch of blocks, leaving some of them in
+   this thread's cache, and exits. */
+static void
+churn_thread (void *aux UNUSED) 
+{
+    void *blocks[BLOCK_CNT];
+    size_t i;
+
+    for (i = 0; i < BLOCK_CNT; i++)
+      {
+        blocks[i] = malloc (48);
+        if (blocks[i] == NULL)
+            fail ("malloc failed");
+      }
+    for (i = 0; i < BLOCK_CNT; i++)
+        free (blocks[i]);
+}
+
+/* A thread to look for with thread_foreach(). */
+struct find_tid 
+  {
+    tid_t tid;                  /* Thread to look for. */
+    bool found;                 /* Whether it was seen. */
+  };
+
+/* Thread action that sets the found member of the struct find_tid
+   that AUX points to if T is the thread it is looking for. */
+static void
+check_tid (struct thread *t, void *aux) 
+{
+    struct find_tid *f = aux;
+
+    if (t->tid == f->tid)
+        f->found = true;
+}
+
+/* Returns true if the thread with TID has not yet left the list
+   of all threads in thread_exit(). */
+static bool
+thread_alive (tid_t tid) 
+{
+    struct find_tid f;
+    enum intr_level old_level;
+
+    f.tid = tid;
+    f.found = false;
+    old_level = intr_disable ();
+    thread_foreach (check_tid, &f);
+    intr_set_level (old_level);
+    return f.found;
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-cache) begin
+(malloc-cache) Lock taken for fewer than 1 in 100 pairs: yes
+(malloc-cache) Exiting thread's cache flushed: yes
+(malloc-cache) end
+EOF
+pass;
@@ -0,0 +1,80 @@
+/* Heap efficiency report.  Allocates a mix of request sizes,
+   mostly small ones with a tail of bigger ones, and compares the
+   bytes requested with the bytes malloc() handed out for them.
+   It also works out what the same requests would have taken
+   with power-of-2 size classes, for comparison. */
+
+#include <stdint.h>
+#include <round.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+#define REQUEST_CNT 1000
+
+static void *blocks[REQUEST_CNT];
+
+/* Returns the size of the Ith request. */
+static size_t
+request_size (size_t i) 
+{
+    uint32_t x = i * 2654435761u;
+
+    x ^= x >> 15;
+    switch (i % 8)
+      {
+      case 0:
+        return 513 + x % 1024;
+      case 1:
+      case 2:
+        return 65 + x % 448;
+      default:
+        return 1 + x % 64;
+      }
+}
+
+/* Returns the bytes a SIZE-byte request takes with power-of-2
+   size classes from 16 to 1024 bytes, and whole pages beyond. */
+static size_t
+pow2_consumed (size_t size) 
+{
+    size_t block_size = 16;
+
+    if (size > 1024)
+        return DIV_ROUND_UP (size + 12, PGSIZE) * PGSIZE;
+    while (block_size < size)
+        block_size *= 2;
+    return block_size;
+}
+
+void
+test_malloc_efficiency (void) 
+{
+    struct malloc_stats before, after;
+    unsigned long long requested, consumed, pow2 = 0;
+    size_t i;
+
+    malloc_stats (&before);
+    for (i = 0; i < REQUEST_CNT; i++)
+      {
+        blocks[i] = malloc (request_size (i));
+        if (blocks[i] == NULL)
+            fail ("malloc failed");
+        pow2 += pow2_consumed (request_size (i));
+      }
+    malloc_stats (&after);
+    for (i = 0; i < REQUEST_CNT; i++)
+        free (blocks[i]);
+
+    requested = after.requested - before.requested;
+    consumed = after.consumed - before.consumed;
+    msg ("%llu bytes requested", requested);
+    msg ("%llu bytes consumed (%llu%% used)", consumed,
+         requested * 100 / consumed);
+    msg ("%llu bytes with power-of-2 classes (%llu%% used)", pow2,
+         requested * 100 / pow2);
+    if (consumed >= pow2)
+        fail ("size classes are no better than powers of 2");
+    pass ();
+}
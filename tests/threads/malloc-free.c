@@ -0,0 +1,69 @@
+/* Allocates enough 16-byte blocks to fill several arenas, frees
+   them in an interleaved order, and checks that every arena but
+   the descriptor's spare goes back to the page allocator, and
+   that a freed block in a full arena is the next one reused. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define BLOCK_CNT 2000
+
+static void *blocks[BLOCK_CNT];
+
+/* Returns the number of pages in use in the kernel pool. */
+static size_t
+kernel_used (void) 
+{
+    struct palloc_stats st;
+
+    palloc_stats (&kernel_pool, &st);
+    return st.used_pages;
+}
+
+void
+test_malloc_free (void) 
+{
+    size_t before, during, i;
+    void *first_arena;
+
+    before = kernel_used ();
+    for (i = 0; i < BLOCK_CNT; i++)
+      {
+        blocks[i] = malloc (16);
+        if (blocks[i] == NULL)
+            fail ("malloc failed");
+      }
+    during = kernel_used ();
+    msg ("Arenas allocated: %s", during > before ? "yes" : "no");
+
+    /* The first arena is full.  Once one of its blocks is freed,
+       it is the fullest arena with a free block, so the next
+       allocation should go there.  A plain free()/malloc() pair
+       would be served from this thread's cache without looking
+       at the arenas at all, so empty the cache before and after
+       the free() to send the block back to its arena, and take it
+       again with malloc_batch(), which bypasses the cache. */
+    first_arena = pg_round_down (blocks[0]);
+    malloc_flush ();
+    free (blocks[0]);
+    malloc_flush ();
+    if (malloc_batch (16, 1, &blocks[0]) != 1)
+        fail ("malloc_batch failed");
+    msg ("Freed block reused from the fullest arena: %s",
+         pg_round_down (blocks[0]) == first_arena ? "yes" : "no");
+
+    /* Even indexes first, then odd ones. */
+    for (i = 0; i < BLOCK_CNT; i += 2)
+        free (blocks[i]);
+    for (i = 1; i < BLOCK_CNT; i += 2)
+        free (blocks[i]);
+
+    /* Blocks still in this thread's cache hold their arenas. */
+    malloc_flush ();
+    msg ("Arenas returned, except one spare: %s",
+         kernel_used () <= before + 1 ? "yes" : "no");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-free) begin
+(malloc-free) Arenas allocated: yes
+(malloc-free) Freed block reused from the fullest arena: yes
+(malloc-free) Arenas returned, except one spare: yes
+(malloc-free) end
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Checks that realloc() resizes blocks in place when it can:
+   a normal block within its size class, and a big block by
+   giving back pages at its end and then taking them back. */
+
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+void
+test_malloc_realloc (void) 
+{
+    char *p, *q;
+
+    p = malloc (20);
+    if (p == NULL)
+        fail ("malloc failed");
+    msg ("Usable size covers the size class: %s",
+         malloc_usable_size (p) == 24 ? "yes" : "no");
+    msg ("Grown within its size class in place: %s",
+         realloc (p, 24) == p ? "yes" : "no");
+    free (p);
+
+    p = malloc (3 * PGSIZE);
+    if (p == NULL)
+        fail ("malloc failed");
+    p[0] = 'x';
+    q = realloc (p, PGSIZE + PGSIZE / 2);
+    msg ("Big block shrunk in place: %s",
+         q == p && malloc_usable_size (q) < 2 * PGSIZE ? "yes" : "no");
+    q = realloc (p, 3 * PGSIZE);
+    msg ("Big block grown back in place: %s",
+         q == p && malloc_usable_size (q) >= 3 * PGSIZE ? "yes" : "no");
+    msg ("Contents kept: %s", q != NULL && q[0] == 'x' ? "yes" : "no");
+    free (q);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-realloc) begin
+(malloc-realloc) Usable size covers the size class: yes
+(malloc-realloc) Grown within its size class in place: yes
+(malloc-realloc) Big block shrunk in place: yes
+(malloc-realloc) Big block grown back in place: yes
+(malloc-realloc) Contents kept: yes
+(malloc-realloc) end
+EOF
+pass;
@@ -0,0 +1,76 @@
+/* Takes a batch of single pages with palloc_get_pages_batch()
+   and a batch of blocks with malloc_batch(), checks that they are
+   distinct and usable, and frees them again. */
+
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define PAGE_CNT 32
+#define BLOCK_CNT 100
+
+static void *pages[PAGE_CNT];
+static void *blocks[BLOCK_CNT];
+
+/* Returns the number of pages in use in the kernel pool. */
+static size_t
+kernel_used (void) 
+{
+    struct palloc_stats st;
+
+    palloc_stats (&kernel_pool, &st);
+    return st.used_pages;
+}
+
+/* Returns true if the CNT pointers in P are all different. */
+static bool
+all_distinct (void **p, size_t cnt) 
+{
+    size_t i, j;
+
+    for (i = 0; i < cnt; i++)
+        for (j = i + 1; j < cnt; j++)
+            if (p[i] == p[j])
+                return false;
+    return true;
+}
+
+void
+test_palloc_batch (void) 
+{
+    struct malloc_stats before, after;
+    size_t used, cnt, i;
+    bool zeroed = true;
+
+    used = kernel_used ();
+    cnt = palloc_get_pages_batch (PAL_ZERO, PAGE_CNT, pages);
+    msg ("Got all pages: %s", cnt == PAGE_CNT ? "yes" : "no");
+    msg ("Pages distinct: %s", all_distinct (pages, cnt) ? "yes" : "no");
+    for (i = 0; i < cnt; i++)
+      {
+        const char *p = pages[i];
+        size_t ofs;
+
+        for (ofs = 0; ofs < PGSIZE; ofs++)
+            if (p[ofs] != 0)
+                zeroed = false;
+      }
+    msg ("Pages zeroed: %s", zeroed ? "yes" : "no");
+    palloc_free_pages_batch (pages, cnt);
+    msg ("Pages returned: %s", kernel_used () == used ? "yes" : "no");
+
+    malloc_stats (&before);
+    cnt = malloc_batch (40, BLOCK_CNT, blocks);
+    malloc_stats (&after);
+    msg ("Got all blocks: %s", cnt == BLOCK_CNT ? "yes" : "no");
+    msg ("Blocks distinct: %s", all_distinct (blocks, cnt) ? "yes" : "no");
+    msg ("Descriptor lock taken once: %s",
+         after.lock_acquires - before.lock_acquires == 1 ? "yes" : "no");
+    for (i = 0; i < cnt; i++)
+      {
+        memset (blocks[i], 0x5a, 40);
+        free (blocks[i]);
+      }
+}
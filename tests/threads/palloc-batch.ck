@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-batch) begin
+(palloc-batch) Got all pages: yes
+(palloc-batch) Pages distinct: yes
+(palloc-batch) Pages zeroed: yes
+(palloc-batch) Pages returned: yes
+(palloc-batch) Got all blocks: yes
+(palloc-batch) Blocks distinct: yes
+(palloc-batch) Descriptor lock taken once: yes
+(palloc-batch) end
+EOF
+pass;
@@ -0,0 +1,103 @@
+/* Measures how often a large allocation from the user pool
+   succeeds after rounds of churn, first with lifetime grouping
+   off and then with it on.  Each round fills three quarters of
+   the pool with short-lived single pages, with a long-lived page
+   after every PIN_EVERY of them, frees the short-lived pages
+   again and then asks for a quarter of the pool in one piece.
+
+   Without grouping, the long-lived pages end up scattered through
+   the space the short-lived ones leave behind, so the large
+   allocation fails.  With it, they are packed together at the
+   bottom of the pool and the large allocation should always
+   succeed. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+
+#define ROUNDS 8
+#define MAX_PAGES 4096
+#define PIN_EVERY 32
+
+static void *short_pages[MAX_PAGES];
+static void *pinned_pages[MAX_PAGES / PIN_EVERY * ROUNDS];
+
+/* Returns a user page allocated with FLAGS, failing the test if
+   there is none. */
+static void *
+get_page (enum palloc_flags flags) 
+{
+    void *page = palloc_get_page (PAL_USER | flags);
+
+    if (page == NULL)
+        fail ("out of user pages");
+    return page;
+}
+
+/* Runs ROUNDS rounds of churn in the user pool, which has
+   POOL_PAGES pages, and returns the number of large allocations
+   that succeeded. */
+static int
+churn (size_t pool_pages) 
+{
+    size_t short_cnt = pool_pages * 3 / 4;
+    size_t big_cnt = pool_pages / 4;
+    size_t pinned_cnt = 0;
+    int successes = 0;
+    int round;
+    size_t i;
+
+    if (short_cnt > MAX_PAGES)
+        short_cnt = MAX_PAGES;
+    for (round = 0; round < ROUNDS; round++)
+      {
+        void *big;
+
+        for (i = 0; i < short_cnt; i++)
+          {
+            short_pages[i] = get_page (PAL_SHORTLIVED);
+            if (i % PIN_EVERY == PIN_EVERY - 1)
+                pinned_pages[pinned_cnt++] = get_page (PAL_PINNED_LONG);
+          }
+        for (i = 0; i < short_cnt; i++)
+            palloc_free_page (short_pages[i]);
+
+        big = palloc_get_multiple (PAL_USER, big_cnt);
+        if (big != NULL)
+          {
+            successes++;
+            palloc_free_multiple (big, big_cnt);
+          }
+      }
+
+    for (i = 0; i < pinned_cnt; i++)
+        palloc_free_page (pinned_pages[i]);
+    return successes;
+}
+
+void
+test_palloc_churn (void) 
+{
+    struct palloc_stats st;
+    size_t pool_pages;
+    int without, with;
+
+    /* Keep the user pool from borrowing, so that only its own
+       layout counts. */
+    palloc_set_floor (&kernel_pool, SIZE_MAX);
+    palloc_set_mode (PAL_FIRST_FIT);
+    palloc_stats (&user_pool, &st);
+    pool_pages = st.free_pages + st.used_pages;
+
+    palloc_set_grouping (false);
+    without = churn (pool_pages);
+    palloc_set_grouping (true);
+    with = churn (pool_pages);
+
+    msg ("Large allocations without grouping: %d of %d", without, ROUNDS);
+    msg ("Large allocations with grouping: %d of %d", with, ROUNDS);
+    if (with < ROUNDS)
+        fail ("grouping should let every large allocation succeed");
+    pass ();
+}
@@ -0,0 +1,51 @@
+/* Checks that palloc_stats() tracks allocations, frees and
+   fragmentation of the user pool. */
+
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include <stdio.h>
+
+void test_palloc_stats (void) 
+{
+    struct palloc_stats before, after;
+    void *a, *b, *c;
+
+    palloc_set_mode (PAL_FIRST_FIT);
+    palloc_stats (&user_pool, &before);
+    msg ("Pool starts as one free extent: %s",
+         before.extent_cnt == 1 && before.largest_free == before.free_pages
+         ? "yes" : "no");
+
+    a = palloc_get_multiple (PAL_USER, 10);
+    b = palloc_get_multiple (PAL_USER, 2);
+    c = palloc_get_multiple (PAL_USER, 5);
+    palloc_free_multiple (b, 2);
+    palloc_stats (&user_pool, &after);
+    msg ("Used pages: %zu", after.used_pages - before.used_pages);
+    msg ("Free extents: %zu", after.extent_cnt);
+    msg ("Extents of 2-3 pages: %zu",
+         after.extent_hist[1] - before.extent_hist[1]);
+    msg ("Largest free extent shrank by %zu pages",
+         before.largest_free - after.largest_free);
+    msg ("First fit allocations: %llu, frees: %llu",
+         after.modes[PAL_FIRST_FIT].allocs
+         - before.modes[PAL_FIRST_FIT].allocs,
+         after.modes[PAL_FIRST_FIT].frees
+         - before.modes[PAL_FIRST_FIT].frees);
+    msg ("Latency percentiles are ordered: %s",
+         after.modes[PAL_FIRST_FIT].alloc_p50
+         <= after.modes[PAL_FIRST_FIT].alloc_p90
+         && after.modes[PAL_FIRST_FIT].alloc_p90
+            <= after.modes[PAL_FIRST_FIT].alloc_p99 ? "yes" : "no");
+
+    msg ("Oversized allocation: %s",
+         palloc_get_multiple (PAL_USER, (size_t) 1 << 20) == NULL
+         ? "failed" : "succeeded");
+    palloc_stats (&user_pool, &before);
+    msg ("First fit failures: %llu",
+         before.modes[PAL_FIRST_FIT].failures
+         - after.modes[PAL_FIRST_FIT].failures);
+
+    palloc_free_multiple (a, 10);
+    palloc_free_multiple (c, 5);
+}
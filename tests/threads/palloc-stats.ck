@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-stats) begin
+(palloc-stats) Pool starts as one free extent: yes
+(palloc-stats) Used pages: 15
+(palloc-stats) Free extents: 2
+(palloc-stats) Extents of 2-3 pages: 1
+(palloc-stats) Largest free extent shrank by 17 pages
+(palloc-stats) First fit allocations: 3, frees: 1
+(palloc-stats) Latency percentiles are ordered: yes
+(palloc-stats) Oversized allocation: failed
+(palloc-stats) First fit failures: 1
+(palloc-stats) end
+EOF
+pass;
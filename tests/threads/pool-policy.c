@@ -0,0 +1,38 @@
+/* Checks that each pool keeps its own allocation policy, and
+   that a pool can switch policies while pages are allocated. */
+
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include <stdio.h>
+
+void test_pool_policy (void) 
+{
+    void *a, *b, *c;
+
+    palloc_set_mode (PAL_FIRST_FIT);
+    palloc_set_pool_mode (&user_pool, PAL_BUDDY);
+    msg ("Kernel pool uses first fit: %s",
+         palloc_get_mode (&kernel_pool) == PAL_FIRST_FIT ? "yes" : "no");
+    msg ("User pool uses buddy: %s",
+         palloc_get_mode (&user_pool) == PAL_BUDDY ? "yes" : "no");
+
+    a = palloc_get_multiple (PAL_USER, 3);
+    b = palloc_get_multiple (PAL_USER, 3);
+    msg ("Buddy: A at index %zu, B at index %zu",
+         palloc_get_page_index (a), palloc_get_page_index (b));
+
+    /* Switch with A and B still allocated. */
+    palloc_set_pool_mode (&user_pool, PAL_FIRST_FIT);
+    c = palloc_get_multiple (PAL_USER, 1);
+    msg ("First fit: C at index %zu", palloc_get_page_index (c));
+
+    palloc_set_pool_mode (&user_pool, PAL_BEST_FIT);
+    palloc_free_multiple (a, 3);
+    a = palloc_get_multiple (PAL_USER, 2);
+    msg ("Best fit: A at index %zu", palloc_get_page_index (a));
+
+    palloc_free_multiple (a, 2);
+    palloc_free_multiple (b, 3);
+    palloc_free_multiple (c, 1);
+    palloc_set_mode (PAL_FIRST_FIT);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pool-policy) begin
+(pool-policy) Kernel pool uses first fit: yes
+(pool-policy) User pool uses buddy: yes
+(pool-policy) Buddy: A at index 0, B at index 4
+(pool-policy) First fit: C at index 3
+(pool-policy) Best fit: A at index 0
+(pool-policy) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* Checks that a pool that runs out of pages borrows them from
+   the other pool, and that the other pool can take them back
+   when it runs out in turn. */
+
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include <stdio.h>
+
+/* Returns the number of pages POOL has now. */
+static size_t
+pool_pages (struct pool *pool) 
+{
+    struct palloc_stats st;
+
+    palloc_stats (pool, &st);
+    return st.free_pages + st.used_pages;
+}
+
+void test_pool_rebalance (void) 
+{
+    struct palloc_stats user, kernel;
+    size_t total = pool_pages (&kernel_pool) + pool_pages (&user_pool);
+    size_t page_cnt;
+    void *p;
+
+    palloc_set_mode (PAL_FIRST_FIT);
+
+    /* More pages than the user pool has. */
+    page_cnt = pool_pages (&user_pool) + 1;
+    p = palloc_get_multiple (PAL_USER, page_cnt);
+    msg ("User pool allocation bigger than the pool: %s",
+         p != NULL ? "succeeded" : "failed");
+    palloc_stats (&user_pool, &user);
+    palloc_stats (&kernel_pool, &kernel);
+    msg ("User pool borrowed from kernel pool: %s",
+         user.borrows == 1 && kernel.loans == 1
+         && user.borrowed_pages == kernel.lent_pages ? "yes" : "no");
+    palloc_free_multiple (p, page_cnt);
+
+    /* Now more pages than the kernel pool has. */
+    page_cnt = pool_pages (&kernel_pool) + 1;
+    p = palloc_get_multiple (0, page_cnt);
+    msg ("Kernel pool allocation bigger than the pool: %s",
+         p != NULL ? "succeeded" : "failed");
+    palloc_stats (&kernel_pool, &kernel);
+    msg ("Kernel pool borrowed pages back: %s",
+         kernel.borrows == 1 && kernel.borrowed_pages > kernel.lent_pages
+         ? "yes" : "no");
+    palloc_free_multiple (p, page_cnt);
+
+    msg ("Pool sizes add up: %s",
+         pool_pages (&kernel_pool) + pool_pages (&user_pool) == total
+         ? "yes" : "no");
+
+    /* Nothing can be bigger than both pools together. */
+    msg ("Allocation bigger than both pools: %s",
+         palloc_get_multiple (PAL_USER, total + 1) == NULL
+         ? "failed" : "succeeded");
+}
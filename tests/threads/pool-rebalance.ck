@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pool-rebalance) begin
+(pool-rebalance) User pool allocation bigger than the pool: succeeded
+(pool-rebalance) User pool borrowed from kernel pool: yes
+(pool-rebalance) Kernel pool allocation bigger than the pool: succeeded
+(pool-rebalance) Kernel pool borrowed pages back: yes
+(pool-rebalance) Pool sizes add up: yes
+(pool-rebalance) Allocation bigger than both pools: failed
+(pool-rebalance) end
+EOF
+pass;
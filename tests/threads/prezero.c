@@ -0,0 +1,44 @@
+/* Checks that pages zeroed ahead of time, as the idle thread
+   does, are handed to PAL_ZERO requests without a memset. */
+
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include <stdio.h>
+
+void test_prezero (void) 
+{
+    struct magazine *mag = &user_pool.mag;
+    unsigned long long hits;
+    void *pages[4];
+    uint8_t *p;
+    size_t i, zeroed;
+
+    /* Starts with an empty magazine. */
+    palloc_set_mode (PAL_FIRST_FIT);
+
+    for (i = 0; i < 4; i++)
+        pages[i] = palloc_get_page (PAL_USER);
+    for (i = 0; i < 4; i++)
+        palloc_free_page (pages[i]);
+    msg ("Magazine holds %zu pages", mag->cnt);
+
+    /* Do what the idle thread would. */
+    zeroed = 0;
+    while (palloc_zero_idle ())
+        zeroed++;
+    msg ("Zeroed %zu pages", zeroed);
+
+    hits = mag->zero_hits;
+    p = palloc_get_page (PAL_USER | PAL_ZERO);
+    msg ("Page came pre-zeroed: %s",
+         mag->zero_hits == hits + 1 ? "yes" : "no");
+    for (i = 0; i < PGSIZE; i++)
+        if (p[i] != 0)
+            break;
+    msg ("Page is all zeros: %s", i == PGSIZE ? "yes" : "no");
+
+    palloc_free_page (p);
+    palloc_set_mode (PAL_FIRST_FIT);
+    msg ("Zeroed pages left after drain: %zu", mag->zeroed_cnt);
+}
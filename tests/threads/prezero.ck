@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(prezero) begin
+(prezero) Magazine holds 16 pages
+(prezero) Zeroed 16 pages
+(prezero) Page came pre-zeroed: yes
+(prezero) Page is all zeros: yes
+(prezero) Zeroed pages left after drain: 0
+(prezero) end
+EOF
+pass;
@@ -0,0 +1,135 @@
+/* Checks that an allocation that finds its pool empty calls the
+   registered shrinkers, lowest priority first, and succeeds with
+   the pages they give back. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+
+#define CACHE_PAGES 8
+
+/* A cache of kernel pages that a shrinker can give back. */
+struct cache {
+    void *pages[CACHE_PAGES];
+    size_t cnt;
+};
+
+static struct cache cache_a, cache_b;
+
+/* Cached pages left in A when B's shrinker was first called,
+   or -1 if it has not been. */
+static int a_left_at_b = -1;
+
+/* Frees up to PAGE_CNT pages of C. */
+static size_t
+shrink_cache (struct cache *c, struct pool *pool, size_t page_cnt) 
+{
+    size_t freed = 0;
+
+    if (pool != &kernel_pool)
+        return 0;
+    while (c->cnt > 0 && freed < page_cnt)
+      {
+        palloc_free_page (c->pages[--c->cnt]);
+        freed++;
+      }
+    return freed;
+}
+
+static size_t
+shrink_a (struct pool *pool, size_t page_cnt) 
+{
+    return shrink_cache (&cache_a, pool, page_cnt);
+}
+
+static size_t
+shrink_b (struct pool *pool, size_t page_cnt) 
+{
+    if (a_left_at_b < 0)
+        a_left_at_b = cache_a.cnt;
+    return shrink_cache (&cache_b, pool, page_cnt);
+}
+
+/* Registered in the wrong order on purpose.  Both run before
+   malloc()'s shrinker, which has priority 0. */
+static struct shrinker shrinker_b =
+  {.name = "test b", .priority = -1, .shrink = shrink_b};
+static struct shrinker shrinker_a =
+  {.name = "test a", .priority = -2, .shrink = shrink_a};
+
+/* Fills C with kernel pages. */
+static void
+fill_cache (struct cache *c) 
+{
+    for (c->cnt = 0; c->cnt < CACHE_PAGES; c->cnt++)
+      {
+        c->pages[c->cnt] = palloc_get_page (0);
+        if (c->pages[c->cnt] == NULL)
+            fail ("out of kernel pages");
+      }
+}
+
+void
+test_shrinker (void) 
+{
+    struct palloc_stats before, after;
+    void *pages = NULL;
+    void *page;
+    size_t got;
+
+    /* Keep the kernel pool from borrowing its way out. */
+    palloc_set_floor (&user_pool, SIZE_MAX);
+
+    /* Fill the caches, then take every other kernel page. */
+    fill_cache (&cache_a);
+    fill_cache (&cache_b);
+    while ((page = palloc_get_page (0)) != NULL)
+      {
+        *(void **) page = pages;
+        pages = page;
+      }
+
+    palloc_register_shrinker (&shrinker_b);
+    palloc_register_shrinker (&shrinker_a);
+    palloc_stats (&kernel_pool, &before);
+
+    page = palloc_get_page (0);
+    msg ("Allocation from an empty pool succeeded: %s",
+         page != NULL ? "yes" : "no");
+    msg ("Shrinker a called %llu times, shrinker b %llu times",
+         shrinker_a.calls, shrinker_b.calls);
+    if (page != NULL)
+      {
+        *(void **) page = pages;
+        pages = page;
+      }
+
+    /* Drain both caches, and whatever else the shrinkers have. */
+    got = 0;
+    while ((page = palloc_get_page (0)) != NULL)
+      {
+        *(void **) page = pages;
+        pages = page;
+        got++;
+      }
+    palloc_stats (&kernel_pool, &after);
+    msg ("Got back every cached page: %s",
+         got >= 2 * CACHE_PAGES - 1 ? "yes" : "no");
+    msg ("Cache a was empty before shrinker b ran: %s",
+         a_left_at_b == 0 ? "yes" : "no");
+    msg ("Shrunk pages counted: %s",
+         after.shrunk_pages - before.shrunk_pages == got + 1 ? "yes" : "no");
+    msg ("Rescued allocations counted: %s",
+         after.shrink_rescues - before.shrink_rescues == got + 1
+         ? "yes" : "no");
+
+    palloc_unregister_shrinker (&shrinker_a);
+    palloc_unregister_shrinker (&shrinker_b);
+    while (pages != NULL)
+      {
+        page = pages;
+        pages = *(void **) page;
+        palloc_free_page (page);
+      }
+}
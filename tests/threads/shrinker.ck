@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shrinker) begin
+(shrinker) Allocation from an empty pool succeeded: yes
+(shrinker) Shrinker a called 1 times, shrinker b 0 times
+(shrinker) Got back every cached page: yes
+(shrinker) Cache a was empty before shrinker b ran: yes
+(shrinker) Shrunk pages counted: yes
+(shrinker) Rescued allocations counted: yes
+(shrinker) end
+EOF
+pass;
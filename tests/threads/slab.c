@@ -0,0 +1,87 @@
+/* Checks that a slab cache constructs each object once, hands
+   freed objects out again without constructing them anew, keeps
+   objects aligned and packed into as few slabs as it can, and
+   reports its occupancy correctly. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/slab.h"
+
+#define OBJ_CNT 200
+#define OBJ_MAGIC 0x0b1ec7ed
+
+/* A test object, with constructor state in MAGIC. */
+struct obj {
+    unsigned magic;
+    char payload[36];
+};
+
+static void
+obj_ctor (void *obj_) 
+{
+    struct obj *obj = obj_;
+
+    obj->magic = OBJ_MAGIC;
+}
+
+static struct obj *objs[OBJ_CNT];
+
+void
+test_slab (void) 
+{
+    struct kmem_cache *cache;
+    struct kmem_cache_stats st;
+    size_t ctor_calls, i;
+    bool ok;
+
+    cache = kmem_cache_create ("test", sizeof (struct obj), 64, obj_ctor);
+    if (cache == NULL)
+        fail ("kmem_cache_create failed");
+
+    ok = true;
+    for (i = 0; i < OBJ_CNT; i++)
+      {
+        objs[i] = kmem_cache_alloc (cache);
+        if (objs[i] == NULL)
+            fail ("kmem_cache_alloc failed");
+        if (objs[i]->magic != OBJ_MAGIC || (uintptr_t) objs[i] % 64 != 0)
+            ok = false;
+      }
+    kmem_cache_stats (cache, &st);
+    msg ("Objects constructed and aligned: %s", ok ? "yes" : "no");
+    msg ("Constructor ran once per object: %s",
+         st.ctor_calls == st.total ? "yes" : "no");
+    msg ("Occupancy: %s",
+         st.in_use == OBJ_CNT && st.total >= OBJ_CNT
+         && st.total - OBJ_CNT < st.objs_per_slab
+         && st.partial_slabs <= 1 && st.empty_slabs == 0 ? "exact" : "wrong");
+
+    /* Free every other object, then allocate them again. */
+    for (i = 0; i < OBJ_CNT; i += 2)
+      {
+        objs[i]->payload[0] = 'x';
+        kmem_cache_free (cache, objs[i]);
+      }
+    ctor_calls = st.ctor_calls;
+    ok = true;
+    for (i = 0; i < OBJ_CNT; i += 2)
+      {
+        objs[i] = kmem_cache_alloc (cache);
+        if (objs[i] == NULL || objs[i]->magic != OBJ_MAGIC
+            || objs[i]->payload[0] != 'x')
+            ok = false;
+      }
+    kmem_cache_stats (cache, &st);
+    msg ("Freed objects reused as they were: %s",
+         ok && st.ctor_calls == ctor_calls ? "yes" : "no");
+
+    /* Free everything: all slabs should end up empty. */
+    for (i = 0; i < OBJ_CNT; i++)
+        kmem_cache_free (cache, objs[i]);
+    kmem_cache_stats (cache, &st);
+    msg ("All slabs empty after freeing: %s",
+         st.in_use == 0 && st.full_slabs == 0 && st.partial_slabs == 0
+         && st.empty_slabs * st.objs_per_slab == st.total ? "yes" : "no");
+    kmem_cache_destroy (cache);
+}
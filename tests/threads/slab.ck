@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab) begin
+(slab) Objects constructed and aligned: yes
+(slab) Constructor ran once per object: yes
+(slab) Occupancy: exact
+(slab) Freed objects reused as they were: yes
+(slab) All slabs empty after freeing: yes
+(slab) end
+EOF
+pass;
@@ -14,6 +14,26 @@ static const struct test tests[] = {
     { "nextfit", test_nextfit },
     { "bestfit", test_bestfit },
     { "buddy", test_buddy },
+    { "tlsf", test_tlsf },
+    { "bitmap-bench", test_bitmap_bench },
+    { "magazine", test_magazine },
+    { "prezero", test_prezero },
+    { "palloc-stats", test_palloc_stats },
+    { "aligned", test_aligned },
+    { "pool-policy", test_pool_policy },
+    { "pool-rebalance", test_pool_rebalance },
+    { "palloc-churn", test_palloc_churn },
+    { "vmalloc", test_vmalloc },
+    { "shrinker", test_shrinker },
+    { "tlb-bench", test_tlb_bench },
+    { "tlb-bench-nopse", test_tlb_bench },
+    { "slab", test_slab },
+    { "malloc-free", test_malloc_free },
+    { "malloc-efficiency", test_malloc_efficiency },
+    { "malloc-cache", test_malloc_cache },
+    { "malloc-big-cache", test_malloc_big_cache },
+    { "malloc-realloc", test_malloc_realloc },
+    { "palloc-batch", test_palloc_batch },
 };
 
 static const char *test_name;
@@ -9,6 +9,25 @@ extern test_func test_firstfit;
 extern test_func test_nextfit;
 extern test_func test_bestfit;
 extern test_func test_buddy;
+extern test_func test_tlsf;
+extern test_func test_bitmap_bench;
+extern test_func test_magazine;
+extern test_func test_prezero;
+extern test_func test_palloc_stats;
+extern test_func test_aligned;
+extern test_func test_pool_policy;
+extern test_func test_pool_rebalance;
+extern test_func test_palloc_churn;
+extern test_func test_vmalloc;
+extern test_func test_shrinker;
+extern test_func test_tlb_bench;
+extern test_func test_slab;
+extern test_func test_malloc_free;
+extern test_func test_malloc_efficiency;
+extern test_func test_malloc_cache;
+extern test_func test_malloc_big_cache;
+extern test_func test_malloc_realloc;
+extern test_func test_palloc_batch;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
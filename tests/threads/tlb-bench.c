@@ -0,0 +1,105 @@
+/* Times reads that touch a different page every time, once
+   through a buffer mapped with 4 kB pages by vmalloc() and once
+   through a buffer of the same size in the kernel's direct
+   mapping, which uses 4 MB pages where it can.  With 4 kB
+   pages, nearly every read misses in the TLB once the buffer
+   has more pages than the TLB has entries.
+
+   The direct buffer is aligned on its own size, so that it lies
+   within a single 4 MB page.  The machine needs more than 4 MB
+   of RAM for the kernel pool to reach past the first 4 MB, which
+   holds kernel text and so keeps 4 kB pages; Make.tests boots it
+   with 64 MB.
+
+   tlb-bench-nopse runs the same test on a kernel booted with
+   -nopse, whose direct mapping uses 4 kB pages too, to give the
+   numbers from before 4 MB pages for comparison.  Both report
+   how the direct buffer is mapped, and their .ck files check
+   it. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+#define PAGE_CNT 1024
+#define MIN_PAGES 64
+#define PASSES 32
+
+/* Reads one word from each of the PAGE_CNT pages of BUF, PASSES
+   times over, in an order that jumps around, and returns the
+   average cycles per read. */
+static uint64_t
+touch (const uint8_t *buf, size_t page_cnt)
+{
+    volatile const uint32_t *word;
+    uint32_t sum = 0;
+    uint64_t start;
+    size_t i, j;
+
+    start = rdtsc ();
+    for (i = 0; i < PASSES; i++)
+        for (j = 0; j < page_cnt; j++)
+          {
+            word = (const uint32_t *) (buf + (j * 97 % page_cnt) * PGSIZE);
+            sum += *word;
+          }
+    (void) sum;
+    return (rdtsc () - start) / (PASSES * page_cnt);
+}
+
+/* Returns how the PAGE_CNT pages at BUF are mapped in the
+   kernel's page directory. */
+static const char *
+mapping_of (const uint8_t *buf, size_t page_cnt)
+{
+    size_t large = 0, small = 0;
+    uintptr_t pde;
+
+    for (pde = pd_no (buf); pde <= pd_no (buf + page_cnt * PGSIZE - 1);
+         pde++)
+        if (init_page_dir[pde] & PTE_PS)
+            large++;
+        else
+            small++;
+    return small == 0 ? "4 MB pages" : large == 0 ? "4 kB pages" : "mixed";
+}
+
+void
+test_tlb_bench (void)
+{
+    size_t page_cnt;
+    uint8_t *direct = NULL, *mapped = NULL;
+
+    /* Use the biggest buffers that both allocators can supply. */
+    for (page_cnt = PAGE_CNT; page_cnt >= MIN_PAGES; page_cnt /= 2)
+      {
+        direct = palloc_get_aligned (PAL_ZERO, page_cnt, page_cnt);
+        mapped = vmalloc (page_cnt * PGSIZE);
+        if (direct != NULL && mapped != NULL)
+            break;
+        palloc_free_multiple (direct, page_cnt);
+        vfree (mapped);
+        direct = mapped = NULL;
+      }
+    if (direct == NULL)
+        fail ("out of memory");
+
+    msg ("Direct buffer mapped with %s", mapping_of (direct, page_cnt));
+
+    /* Warm up both, then time them. */
+    touch (mapped, page_cnt);
+    touch (direct, page_cnt);
+    msg ("%zu pages: %llu cycles per read with 4 kB pages, "
+         "%llu cycles per read from the direct mapping",
+         page_cnt, touch (mapped, page_cnt), touch (direct, page_cnt));
+
+    vfree (mapped);
+    palloc_free_multiple (direct, page_cnt);
+    pass ();
+}
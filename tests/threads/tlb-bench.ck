@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "direct buffer not mapped with 4 MB pages"
+  unless grep ($_ eq '(tlb-bench) Direct buffer mapped with 4 MB pages', @output);
+fail "missing PASS in output"
+  unless grep ($_ eq '(tlb-bench) PASS', @output);
+
+pass;
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(tlsf) begin
+(tlsf) Allocated A (10 pages) at index 0
+(tlsf) Allocated B (2 pages) at index 10
+(tlsf) Allocated C (5 pages) at index 12
+(tlsf) Freed A (10 pages)
+(tlsf) Allocated D (3 pages) at index 0 - TLSF test
+(tlsf) end
+EOF
+pass;
@@ -0,0 +1,80 @@
+/* Checks that vmalloc() builds virtually contiguous buffers out
+   of single pages, and that a big malloc() falls back to it when
+   the kernel pool has no long enough run of free pages. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* Fills the SIZE bytes at P with a pattern and returns true if
+   they read back correctly. */
+static bool
+fill_and_check (uint8_t *p, size_t size) 
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        p[i] = i % 251;
+    for (i = 0; i < size; i++)
+        if (p[i] != i % 251)
+            return false;
+    return true;
+}
+
+void
+test_vmalloc (void) 
+{
+    void *pages = NULL;
+    void *page;
+    uint8_t *p, *q;
+
+    p = vmalloc (64 * PGSIZE);
+    msg ("64-page buffer lies outside the kernel pool: %s",
+         p != NULL && is_vmalloc_addr (p) ? "yes" : "no");
+    msg ("Buffer holds what was written: %s",
+         fill_and_check (p, 64 * PGSIZE) ? "yes" : "no");
+    vfree (p);
+    q = vmalloc (64 * PGSIZE);
+    msg ("Freed address space is reused: %s", q == p ? "yes" : "no");
+    vfree (q);
+
+    /* Fragment the kernel pool: take every page it has, without
+       letting it borrow any, and give back every other one.  Each
+       page links to the one allocated before it. */
+    palloc_set_floor (&user_pool, SIZE_MAX);
+    while ((page = palloc_get_page (0)) != NULL)
+      {
+        *(void **) page = pages;
+        pages = page;
+      }
+    for (page = pages; page != NULL; page = *(void **) page)
+      {
+        void *next = *(void **) page;
+
+        if (next == NULL)
+            break;
+        *(void **) page = *(void **) next;
+        palloc_free_page (next);
+      }
+
+    msg ("8 contiguous pages are available: %s",
+         palloc_get_multiple (0, 8) != NULL ? "yes" : "no");
+    p = malloc (8 * PGSIZE);
+    msg ("8-page malloc() fell back to vmalloc(): %s",
+         p != NULL && is_vmalloc_addr (p) ? "yes" : "no");
+    msg ("Block holds what was written: %s",
+         fill_and_check (p, 8 * PGSIZE) ? "yes" : "no");
+    free (p);
+
+    while (pages != NULL)
+      {
+        page = pages;
+        pages = *(void **) page;
+        palloc_free_page (page);
+      }
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vmalloc) begin
+(vmalloc) 64-page buffer lies outside the kernel pool: yes
+(vmalloc) Buffer holds what was written: yes
+(vmalloc) Freed address space is reused: yes
+(vmalloc) 8 contiguous pages are available: no
+(vmalloc) 8-page malloc() fell back to vmalloc(): yes
+(vmalloc) Block holds what was written: yes
+(vmalloc) end
+EOF
+pass;
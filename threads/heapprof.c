@@ -0,0 +1,200 @@
+#include "threads/heapprof.h"
+
+#ifdef HEAPPROF
+
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Live allocations are kept in an open-addressed hash table with
+   linear probing, in static memory so that recording one never
+   allocates.  A removed entry's successors in its probe sequence
+   are shifted back over it, so there are no tombstones.
+   Allocations made while the table is full are only counted. */
+
+/* One live allocation. */
+struct alloc {
+    const void *ptr;    /* Address handed out, or null if slot unused. */
+    const void *caller; /* Return address of the allocating call. */
+    size_t size;        /* Bytes asked for, or pages for HEAPPROF_PALLOC. */
+    enum heapprof_kind kind;
+};
+
+#define ALLOC_CNT 4096 /* Slots in the table; a power of 2. */
+static struct alloc allocs[ALLOC_CNT];
+static size_t alloc_cnt;     /* Slots in use. */
+static size_t untracked_cnt; /* Allocations that did not fit. */
+
+/* Totals for one call site, built by heapprof_dump(). */
+struct site {
+    const void *caller;
+    enum heapprof_kind kind;
+    size_t bytes;       /* Live bytes allocated from here. */
+    size_t cnt;         /* Live allocations made from here. */
+};
+
+#define SITE_CNT 256 /* Most call sites heapprof_dump() lists. */
+static struct site sites[SITE_CNT];
+
+/* Returns the slot where P's probe sequence starts. */
+static size_t
+home_slot(const void *p)
+{
+    return hash_int((uintptr_t)p) & (ALLOC_CNT - 1);
+}
+
+/* Returns the slot holding P, or the empty slot where it would
+   go.  Interrupts must be off. */
+static size_t
+find_slot(const void *p)
+{
+    size_t i = home_slot(p);
+
+    while (allocs[i].ptr != NULL && allocs[i].ptr != p)
+        i = (i + 1) & (ALLOC_CNT - 1);
+    return i;
+}
+
+/* Records that SIZE bytes of KIND were allocated at P from
+   CALLER.  If P is already recorded, as when calloc() calls
+   malloc(), the entry is replaced, so that the outermost
+   allocating call is the one that counts. */
+void heapprof_alloc(const void *p, size_t size, enum heapprof_kind kind,
+                    const void *caller)
+{
+    enum intr_level old_level;
+    size_t i;
+
+    if (p == NULL)
+        return;
+
+    old_level = intr_disable();
+    i = find_slot(p);
+    if (allocs[i].ptr == NULL) {
+        /* Keep one slot empty so that probes end. */
+        if (alloc_cnt >= ALLOC_CNT - 1) {
+            untracked_cnt++;
+            intr_set_level(old_level);
+            return;
+        }
+        alloc_cnt++;
+    }
+    allocs[i].ptr = p;
+    allocs[i].caller = caller;
+    allocs[i].size = size;
+    allocs[i].kind = kind;
+    intr_set_level(old_level);
+}
+
+/* Records that the allocation at P, if it was recorded, now has
+   SIZE bytes, or pages for HEAPPROF_PALLOC. */
+void heapprof_resize(const void *p, size_t size)
+{
+    enum intr_level old_level;
+    size_t i;
+
+    old_level = intr_disable();
+    i = find_slot(p);
+    if (allocs[i].ptr != NULL)
+        allocs[i].size = size;
+    intr_set_level(old_level);
+}
+
+/* Forgets the allocation at P, if it was recorded. */
+void heapprof_free(const void *p)
+{
+    enum intr_level old_level;
+    size_t i, j;
+
+    if (p == NULL)
+        return;
+
+    old_level = intr_disable();
+    i = find_slot(p);
+    if (allocs[i].ptr != NULL) {
+        /* Shift back each later entry in the probe sequence whose
+           home slot does not lie cyclically in (I, J]. */
+        for (j = (i + 1) & (ALLOC_CNT - 1); allocs[j].ptr != NULL;
+             j = (j + 1) & (ALLOC_CNT - 1)) {
+            size_t home = home_slot(allocs[j].ptr);
+
+            if (((j - home) & (ALLOC_CNT - 1))
+                >= ((j - i) & (ALLOC_CNT - 1))) {
+                allocs[i] = allocs[j];
+                i = j;
+            }
+        }
+        allocs[i].ptr = NULL;
+        alloc_cnt--;
+    }
+    intr_set_level(old_level);
+}
+
+/* Prints the live bytes and allocations of each call site, most
+   bytes first.  Not safe to call from two threads at once.  The
+   call sites can be turned into function names and line numbers
+   by passing the "Heap sites:" line printed last to the backtrace
+   utility. */
+void heapprof_dump(void)
+{
+    enum intr_level old_level;
+    size_t site_cnt = 0, bytes = 0, lost = 0;
+    size_t live_cnt, untracked;
+    size_t i, j;
+
+    old_level = intr_disable();
+    for (i = 0; i < ALLOC_CNT; i++) {
+        struct alloc *a = &allocs[i];
+        size_t size;
+
+        if (a->ptr == NULL)
+            continue;
+        size = a->kind == HEAPPROF_PALLOC ? a->size * PGSIZE : a->size;
+        bytes += size;
+        for (j = 0; j < site_cnt; j++)
+            if (sites[j].caller == a->caller && sites[j].kind == a->kind)
+                break;
+        if (j == site_cnt) {
+            if (site_cnt >= SITE_CNT) {
+                lost++;
+                continue;
+            }
+            sites[site_cnt].caller = a->caller;
+            sites[site_cnt].kind = a->kind;
+            sites[site_cnt].bytes = sites[site_cnt].cnt = 0;
+            site_cnt++;
+        }
+        sites[j].bytes += size;
+        sites[j].cnt++;
+    }
+    live_cnt = alloc_cnt;
+    untracked = untracked_cnt;
+    intr_set_level(old_level);
+
+    printf("Heap profile: %zu bytes live in %zu allocations, "
+           "%zu untracked, %zu uncounted\n",
+           bytes, live_cnt, untracked, lost);
+
+    /* Sort by bytes, biggest first.  There are few sites. */
+    for (i = 1; i < site_cnt; i++) {
+        struct site s = sites[i];
+
+        for (j = i; j > 0 && sites[j - 1].bytes < s.bytes; j--)
+            sites[j] = sites[j - 1];
+        sites[j] = s;
+    }
+    for (i = 0; i < site_cnt; i++)
+        printf("Heap profile: #%zu %p %s: %zu bytes in %zu allocations\n", i,
+               sites[i].caller,
+               sites[i].kind == HEAPPROF_PALLOC ? "palloc" : "malloc",
+               sites[i].bytes, sites[i].cnt);
+
+    printf("Heap sites:");
+    for (i = 0; i < site_cnt; i++)
+        printf(" %p", sites[i].caller);
+    printf(".\n");
+}
+
+#endif /* HEAPPROF */
@@ -0,0 +1,51 @@
+#ifndef THREADS_HEAPPROF_H
+#define THREADS_HEAPPROF_H
+
+#include <debug.h>
+#include <stddef.h>
+
+/* Heap profiler.
+
+   When the kernel is built with HEAPPROF defined, for example
+   with "make clean && make DEFINES=-DHEAPPROF" in the build
+   directory, malloc(), calloc(), realloc() and the palloc_get_*()
+   functions record each live allocation and the address it was
+   made from, and heapprof_dump() prints the live bytes and
+   allocations of each call site.  Pages that malloc() itself
+   takes from the page allocator show up as palloc allocations
+   made from malloc().  Without HEAPPROF these calls
+   compile to nothing. */
+
+/* Kinds of allocation recorded. */
+enum heapprof_kind {
+    HEAPPROF_MALLOC, /* Block from malloc(). */
+    HEAPPROF_PALLOC  /* Pages from palloc_get_*(). */
+};
+
+#ifdef HEAPPROF
+void heapprof_alloc(const void *, size_t size, enum heapprof_kind,
+                    const void *caller);
+void heapprof_resize(const void *, size_t size);
+void heapprof_free(const void *);
+void heapprof_dump(void);
+#else
+static inline void
+heapprof_alloc(const void *p UNUSED, size_t size UNUSED,
+               enum heapprof_kind kind UNUSED, const void *caller UNUSED)
+{
+}
+static inline void
+heapprof_resize(const void *p UNUSED, size_t size UNUSED)
+{
+}
+static inline void
+heapprof_free(const void *p UNUSED)
+{
+}
+static inline void
+heapprof_dump(void)
+{
+}
+#endif
+
+#endif /* threads/heapprof.h */
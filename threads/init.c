@@ -21,7 +21,9 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/vmalloc.h"
 #include "tests/threads/tests.h"
 
 /* Page directory with kernel mappings only. */
@@ -29,11 +31,21 @@ uint32_t *init_page_dir;
 
 
 
+/* Most RAM the kernel can use, in pages: all of its virtual
+   address space, from PHYS_BASE up, except the vmalloc region. */
+#define RAM_MAX_PAGES \
+    ((size_t)((uintptr_t)0 - (uintptr_t)PHYS_BASE) / PGSIZE - VMALLOC_PAGES)
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -nopse: Map RAM with 4 kB pages only, without global entries. */
+static bool no_large_pages;
+
 static void bss_init(void);
+static void ram_init(void);
 static void paging_init(void);
+static uint32_t cpu_features(void);
 
 static char **read_command_line(void);
 static char **parse_options(char **argv);
@@ -52,6 +64,9 @@ int main(void)
     /* Clear BSS. */
     bss_init();
 
+    /* Find out how much RAM there is. */
+    ram_init();
+
     /* Break command line into arguments and parse options. */
     argv = read_command_line();
     argv = parse_options(argv);
@@ -68,7 +83,9 @@ int main(void)
     /* Initialize memory system. */
     palloc_init(user_page_limit);
     malloc_init();
+    slab_init();
     paging_init();
+    vmalloc_init();
 
     /* Segmentation. */
 
@@ -110,18 +127,64 @@ bss_init(void)
     memset(&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Sets init_ram_pages from the BIOS memory map, if start.S got
+   one, to the end of the highest range of usable RAM or
+   RAM_MAX_PAGES, whichever is lower.  palloc_init() keeps holes
+   below that out of its pools.  Without a map, init_ram_pages
+   keeps the size start.S found, which is at most 64 MB. */
+static void
+ram_init(void)
+{
+    uint64_t end = 0;
+    uint32_t i;
+
+    for (i = 0; i < init_e820_cnt; i++) {
+        const struct e820_entry *e = &init_e820_map[i];
+
+        if (e->type == E820_USABLE && e->base + e->length > end)
+            end = e->base + e->length;
+    }
+    if (end == 0)
+        return;
+
+    end /= PGSIZE;
+    init_ram_pages = end < RAM_MAX_PAGES ? end : RAM_MAX_PAGES;
+}
+
+/* CPUID leaf 1 feature flags, in EDX. */
+#define CPUID_PSE (1 << 3)  /* 4 MB pages. */
+#define CPUID_PGE (1 << 13) /* Global pages. */
+
+/* CR4 bits. */
+#define CR4_PSE 0x00000010 /* Page Size Extensions. */
+#define CR4_PGE 0x00000080 /* Page Global Enable. */
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports 4 MB pages, every 4 MB of RAM that is
+   aligned, complete and clear of the kernel's text is mapped by
+   a single PDE, with no page table.  The rest, including the
+   first 4 MB, keeps 4 kB pages so that kernel text stays
+   read-only.  If the CPU supports global pages, the whole
+   mapping is global, since it is the same in every address
+   space.  The -nopse option turns off both, so that the two
+   kinds of mapping can be compared on the same machine. */
 static void
 paging_init(void)
 {
     uint32_t *pd, *pt;
     size_t page;
+    size_t large_cnt = 0, pt_cnt = 0;
     extern char _start, _end_kernel_text;
+    uint32_t features = no_large_pages ? 0 : cpu_features();
+    uint32_t global = features & CPUID_PGE ? PTE_G : 0;
+    uint32_t cr4;
 
-    pd = init_page_dir = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    pd = init_page_dir =
+        palloc_get_page(PAL_ASSERT | PAL_ZERO | PAL_PINNED_LONG);
     pt = NULL;
     for (page = 0; page < init_ram_pages; page++) {
         uintptr_t paddr = page * PGSIZE;
@@ -130,12 +193,29 @@ paging_init(void)
         size_t pte_idx = pt_no(vaddr);
         bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+        if ((features & CPUID_PSE) && pte_idx == 0
+            && page + PTSPAN / PGSIZE <= init_ram_pages
+            && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text)) {
+            pd[pde_idx] = pde_create_large(vaddr, true) | global;
+            page += PTSPAN / PGSIZE - 1;
+            large_cnt++;
+            continue;
+        }
+
         if (pd[pde_idx] == 0) {
-            pt = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+            pt = palloc_get_page(PAL_ASSERT | PAL_ZERO | PAL_PINNED_LONG);
             pd[pde_idx] = pde_create(pt);
+            pt_cnt++;
         }
 
-        pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text);
+        pt[pte_idx] = pte_create_kernel(vaddr, !in_kernel_text) | global;
+    }
+
+    /* 4 MB PDEs must be enabled before they are loaded.  See
+     [IA32-v3a] 3.7.3 "Mixing 4-KByte and 4-MByte Pages". */
+    if (features & CPUID_PSE) {
+        asm volatile("movl %%cr4, %0" : "=r"(cr4));
+        asm volatile("movl %0, %%cr4" : : "r"(cr4 | CR4_PSE));
     }
 
     /* Store the physical address of the page directory into CR3
@@ -144,6 +224,24 @@ paging_init(void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
     asm volatile("movl %0, %%cr3" : : "r"(vtop(init_page_dir)));
+
+    if (global) {
+        asm volatile("movl %%cr4, %0" : "=r"(cr4));
+        asm volatile("movl %0, %%cr4" : : "r"(cr4 | CR4_PGE));
+    }
+
+    printf("Kernel mapping: %zu 4 MB pages, %zu page tables%s.\n",
+           large_cnt, pt_cnt, global ? ", global" : "");
+}
+
+/* Returns the CPUID leaf 1 feature flags in EDX. */
+static uint32_t
+cpu_features(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return edx;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -196,6 +294,8 @@ parse_options(char **argv)
             shutdown_configure(SHUTDOWN_POWER_OFF);
         else if (!strcmp(name, "-r"))
             shutdown_configure(SHUTDOWN_REBOOT);
+        else if (!strcmp(name, "-nopse"))
+            no_large_pages = true;
 
         else
             PANIC("unknown option `%s' (use -h for help)", name);
@@ -276,6 +376,11 @@ usage(void)
            "Actions are executed in the order specified.\n"
            "\nAvailable actions:\n"
            "  run TEST           Run TEST.\n"
+           "\nOptions:\n"
+           "  -h                 Print this help message and power off.\n"
+           "  -q                 Power off VM after actions or on panic.\n"
+           "  -r                 Reboot after actions.\n"
+           "  -nopse             Map RAM with 4 kB pages only.\n"
     );
     shutdown_power_off();
 }
@@ -30,11 +30,29 @@
 #define SEL_KCSEG 0x08 /* Kernel code selector. */
 #define SEL_KDSEG 0x10 /* Kernel data selector. */
 
+/* BIOS memory map, from interrupt 15h function e820h. */
+#define LOADER_E820_MAX 32   /* Most entries kept. */
+#define LOADER_E820_SIZE 20  /* Bytes per entry. */
+#define E820_USABLE 1        /* Type of an entry for usable RAM. */
+
 #ifndef __ASSEMBLER__
 #include <stdint.h>
 
 /* Amount of physical memory, in 4 kB pages. */
 extern uint32_t init_ram_pages;
+
+/* One range of physical memory in the BIOS memory map. */
+struct e820_entry {
+    uint64_t base;   /* Physical address of first byte. */
+    uint64_t length; /* Length in bytes. */
+    uint32_t type;   /* E820_USABLE, or something else. */
+} __attribute__((packed));
+
+/* The BIOS memory map, as start.S found it.  Entries may be in
+   any order and may overlap.  If the BIOS does not support
+   e820h, init_e820_cnt is 0. */
+extern uint32_t init_e820_cnt;
+extern struct e820_entry init_e820_map[LOADER_E820_MAX];
 #endif
 
 #endif /* threads/loader.h */
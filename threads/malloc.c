@@ -6,77 +6,205 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
+#include "threads/heapprof.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
-
-   Otherwise, a new page of memory, called an "arena", is
-   obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
+   The size of each request, in bytes, is rounded up to the
+   nearest size class and assigned to the "descriptor" that
+   manages blocks of that size.  The classes are the powers of 2
+   from 16 bytes and the sizes halfway between them (16, 24, 32,
+   48, 64, 96, ...), so no block is more than a third bigger
+   than the request it satisfies, and a table maps each request
+   size to its class in one step.  Blocks come from pages of
+   memory called "arenas", each of which is divided into blocks
+   of one size and keeps a list of its own free blocks.  The
+   descriptor keeps a list of its partial arenas, those with some
+   blocks free and some in use.  If the list is nonempty, a block
+   from the arena at its front is used to satisfy the request.
+
+   Otherwise, a new arena is obtained from the page allocator
+   (if none is available, malloc() returns a null pointer).  The
+   new arena is divided into blocks and goes on the partial
    list.  Then we return one of the new blocks.
 
-   When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
-
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
+   When we free a block, we add it to its arena's free list.  An
+   arena that was full goes back on the front of the partial
+   list, and one that drops to half full moves to the back, so
+   that allocations keep filling the fullest arenas and the
+   emptiest ones have a chance to empty out.  If the arena now
+   has no in-use blocks, we take it off the partial list and give
+   it back to the page allocator, all in constant time.  Each
+   descriptor keeps one such empty arena as a spare instead, so
+   that a block freed and allocated over and over does not take
+   a page from the page allocator each time.  The page allocator
+   takes the spares back through a shrinker when it runs out of
+   pages.
+
+   Each thread also keeps a small cache of free blocks of each
+   size class in its struct thread.  malloc() takes a block from
+   the cache and free() puts one there, neither taking the
+   descriptor's lock.  Only an empty cache is refilled, and a
+   full one flushed, by moving a batch of blocks between it and
+   the descriptor under the lock.  A thread's cached blocks count
+   as in use to their arenas; thread_exit() gives them back.
+
+   We can't handle blocks bigger than 1.5 kB using this scheme,
+   because fewer than two of them fit in a single page with an
+   arena header.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.  If the
+   page allocator has no run of free pages that long, we fall
+   back to vmalloc(), which only makes them contiguous in virtual
+   memory.
+
+   realloc() keeps a block where it is whenever it can: a normal
+   block as long as the new size fits its size class without
+   wasting more than half of it, and a big block by freeing pages
+   at its end, or claiming the free pages that follow it.
+
+   A freed big block of up to BIG_BINS pages is not given back
+   right away but kept in a bin for blocks of its page count, so
+   that the next request for as many pages takes it in constant
+   time without searching the page allocator.  The bins hold at
+   most BIG_CACHE_PAGES pages between them, and the page
+   allocator empties them through a shrinker when it runs out of
+   pages. */
 
 /* Descriptor. */
 struct desc {
     size_t block_size;       /* Size of each element in bytes. */
     size_t blocks_per_arena; /* Number of blocks in an arena. */
-    struct list free_list;   /* List of free blocks. */
+    struct list partial;     /* Arenas with some blocks free. */
+    struct arena *spare;     /* Empty arena kept for reuse, or null. */
+    size_t cache_size;       /* Blocks a thread may cache. */
+    size_t cache_batch;      /* Blocks moved to or from a cache at once. */
     struct lock lock;        /* Lock. */
+    size_t cached;           /* Blocks in thread caches. */
+    unsigned long long lock_acquires; /* Times LOCK was taken. */
+
+    /* Updated with interrupts off, since a cache hit takes no lock. */
+    unsigned long long allocs;    /* Blocks handed out. */
+    unsigned long long requested; /* Bytes asked for in them. */
 };
 
+/* Most blocks of one size class that a thread may cache. */
+#define CACHE_MAX 16
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
 /* Arena. */
 struct arena {
-    unsigned magic;    /* Always set to ARENA_MAGIC. */
-    struct desc *desc; /* Owning descriptor, null for big block. */
-    size_t free_cnt;   /* Free blocks; pages in big block. */
+    unsigned magic;                /* Always set to ARENA_MAGIC. */
+    struct desc *desc;             /* Owning descriptor, null for big block. */
+    size_t free_cnt;               /* Free blocks; pages in big block. */
+    struct block *free;            /* Free blocks. */
+    struct list_elem partial_elem; /* Element in desc's partial list. */
 };
 
 /* Free block. */
 struct block {
-    struct list_elem free_elem; /* Free list element. */
+    struct block *next_free; /* Next free block in arena, or null. */
 };
 
 /* Our set of descriptors. */
-static struct desc descs[10]; /* Descriptors. */
+static struct desc descs[MALLOC_CLASS_MAX]; /* Descriptors. */
 static size_t desc_cnt;       /* Number of descriptors. */
 
+/* Request sizes are mapped to descriptors in steps of
+   CLASS_STEP bytes.  size_class[(SIZE - 1) / CLASS_STEP] is the
+   index in descs of the descriptor for a SIZE-byte request, or
+   desc_cnt if SIZE is too big for any. */
+#define CLASS_STEP 8
+static uint8_t size_class[PGSIZE / 2 / CLASS_STEP];
+
+/* Freed big blocks, binned by page count: big_bins[N - 1] holds
+   blocks of N pages, most recently freed first, chained through
+   their arenas' partial_elem. */
+#define BIG_BINS 16         /* Largest cached block, in pages. */
+#define BIG_CACHE_PAGES 64  /* Most pages kept in all bins. */
+static struct list big_bins[BIG_BINS];
+static size_t big_cached_pages;       /* Pages in big_bins. */
+
+/* Big blocks handed out and bytes asked for in them. */
+static unsigned long long big_allocs, big_requested;
+static unsigned long long big_pages;  /* Pages they took. */
+static unsigned long long big_cache_hits; /* Allocations from big_bins. */
+static struct lock big_lock;          /* Protects the above. */
+
 static struct arena *block_to_arena(struct block *);
 static struct block *arena_to_block(struct arena *, size_t idx);
+static struct desc *find_desc(size_t size);
+static struct block *take_block(struct desc *);
+static void put_block(struct desc *, struct block *);
+static size_t refill_cache(struct desc *, struct malloc_cache *);
+static void flush_cache(struct desc *, struct malloc_cache *, size_t cnt);
+static void free_big_block(struct arena *);
+static void stats_snapshot(struct malloc_stats *);
+static size_t shrink_spares(struct pool *, size_t page_cnt);
+static size_t shrink_big_bins(struct pool *, size_t page_cnt);
+
+/* Gives spare arenas back to the page allocator. */
+static struct shrinker spare_shrinker = {
+    .name = "malloc spare arenas",
+    .priority = 0,
+    .shrink = shrink_spares,
+};
+
+/* Gives cached big blocks back to the page allocator. */
+static struct shrinker big_bin_shrinker = {
+    .name = "malloc big-block cache",
+    .priority = 0,
+    .shrink = shrink_big_bins,
+};
 
 /* Initializes the malloc() descriptors. */
 void malloc_init(void)
 {
-    size_t block_size;
+    size_t block_size, i;
 
-    for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
+    /* Make descriptors for every size class with room for at
+       least two blocks in an arena. */
+    for (block_size = 16; (PGSIZE - sizeof(struct arena)) / block_size >= 2;
+         block_size += (block_size & (block_size - 1)) == 0 ? block_size / 2
+                                                            : block_size / 3) {
         struct desc *d = &descs[desc_cnt++];
         ASSERT(desc_cnt <= sizeof descs / sizeof *descs);
         d->block_size = block_size;
         d->blocks_per_arena = (PGSIZE - sizeof(struct arena)) / block_size;
-        list_init(&d->free_list);
+        list_init(&d->partial);
+        d->spare = NULL;
+        d->cache_size = d->blocks_per_arena / 2;
+        if (d->cache_size > CACHE_MAX)
+            d->cache_size = CACHE_MAX;
+        d->cache_batch = DIV_ROUND_UP(d->cache_size, 2);
         lock_init(&d->lock);
+        d->cached = 0;
+        d->lock_acquires = 0;
+        d->allocs = d->requested = 0;
     }
+
+    /* Map each request size to the smallest descriptor big enough. */
+    for (i = 0; i < sizeof size_class; i++) {
+        size_t size = (i + 1) * CLASS_STEP, k;
+
+        for (k = 0; k < desc_cnt; k++)
+            if (descs[k].block_size >= size)
+                break;
+        size_class[i] = k;
+    }
+
+    for (i = 0; i < BIG_BINS; i++)
+        list_init(&big_bins[i]);
+    lock_init(&big_lock);
+    palloc_register_shrinker(&spare_shrinker);
+    palloc_register_shrinker(&big_bin_shrinker);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -85,8 +213,10 @@ void *
 malloc(size_t size)
 {
     struct desc *d;
+    struct malloc_cache *c;
     struct block *b;
     struct arena *a;
+    enum intr_level old_level;
 
     /* A null pointer satisfies a request for 0 bytes. */
     if (size == 0)
@@ -94,54 +224,109 @@ malloc(size_t size)
 
     /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-    for (d = descs; d < descs + desc_cnt; d++)
-        if (d->block_size >= size)
-            break;
-    if (d == descs + desc_cnt) {
+    d = find_desc(size);
+    if (d == NULL) {
         /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
         size_t page_cnt = DIV_ROUND_UP(size + sizeof *a, PGSIZE);
-        a = palloc_get_multiple(0, page_cnt);
-        if (a == NULL)
-            return NULL;
 
-        /* Initialize the arena to indicate a big block of PAGE_CNT
-         pages, and return it. */
-        a->magic = ARENA_MAGIC;
-        a->desc = NULL;
-        a->free_cnt = page_cnt;
+        /* Reuse a cached block of PAGE_CNT pages if there is one. */
+        a = NULL;
+        lock_acquire(&big_lock);
+        if (page_cnt <= BIG_BINS && !list_empty(&big_bins[page_cnt - 1])) {
+            a = list_entry(list_pop_front(&big_bins[page_cnt - 1]),
+                           struct arena, partial_elem);
+            big_cached_pages -= page_cnt;
+            big_cache_hits++;
+        }
+        lock_release(&big_lock);
+
+        if (a == NULL) {
+            a = palloc_get_multiple(0, page_cnt);
+            if (a == NULL)
+                a = vmalloc(page_cnt * PGSIZE);
+            if (a == NULL)
+                return NULL;
+
+            /* Initialize the arena to indicate a big block of
+               PAGE_CNT pages. */
+            a->magic = ARENA_MAGIC;
+            a->desc = NULL;
+            a->free_cnt = page_cnt;
+        }
+
+        lock_acquire(&big_lock);
+        big_allocs++;
+        big_requested += size;
+        big_pages += page_cnt;
+        lock_release(&big_lock);
+        heapprof_alloc(a + 1, size, HEAPPROF_MALLOC,
+                       __builtin_return_address(0));
         return a + 1;
     }
 
-    lock_acquire(&d->lock);
-
-    /* If the free list is empty, create a new arena. */
-    if (list_empty(&d->free_list)) {
-        size_t i;
+    /* Take a block from this thread's cache, refilling it from
+       the descriptor if it is empty. */
+    c = &thread_current()->malloc_cache;
+    if (c->cnt[d - descs] == 0 && refill_cache(d, c) == 0)
+        return NULL;
+    b = c->blocks[d - descs];
+    c->blocks[d - descs] = b->next_free;
+    c->cnt[d - descs]--;
+
+    old_level = intr_disable();
+    d->allocs++;
+    d->requested += size;
+    intr_set_level(old_level);
+    heapprof_alloc(b, size, HEAPPROF_MALLOC, __builtin_return_address(0));
+    return b;
+}
 
-        /* Allocate a page. */
-        a = palloc_get_page(0);
-        if (a == NULL) {
-            lock_release(&d->lock);
-            return NULL;
-        }
+/* Obtains up to CNT blocks of at least SIZE bytes each, stores
+   them in BLOCKS, and returns the number obtained.  Blocks of a
+   size class are taken from its arenas under a single acquisition
+   of the descriptor's lock, bypassing the thread's cache.  Big
+   blocks are allocated one at a time.  Each block is freed with
+   free() as usual. */
+size_t malloc_batch(size_t size, size_t cnt, void **blocks)
+{
+    struct desc *d;
+    enum intr_level old_level;
+    size_t i;
 
-        /* Initialize arena and add its blocks to the free list. */
-        a->magic = ARENA_MAGIC;
-        a->desc = d;
-        a->free_cnt = d->blocks_per_arena;
-        for (i = 0; i < d->blocks_per_arena; i++) {
-            struct block *b = arena_to_block(a, i);
-            list_push_back(&d->free_list, &b->free_elem);
+    if (size == 0)
+        return 0;
+
+    d = find_desc(size);
+    if (d == NULL) {
+        for (i = 0; i < cnt; i++) {
+            blocks[i] = malloc(size);
+            if (blocks[i] == NULL)
+                break;
+            heapprof_alloc(blocks[i], size, HEAPPROF_MALLOC,
+                           __builtin_return_address(0));
         }
+        return i;
     }
 
-    /* Get a block from free list and return it. */
-    b = list_entry(list_pop_front(&d->free_list), struct block, free_elem);
-    a = block_to_arena(b);
-    a->free_cnt--;
+    lock_acquire(&d->lock);
+    d->lock_acquires++;
+    for (i = 0; i < cnt; i++) {
+        blocks[i] = take_block(d);
+        if (blocks[i] == NULL)
+            break;
+    }
     lock_release(&d->lock);
-    return b;
+    cnt = i;
+
+    old_level = intr_disable();
+    d->allocs += cnt;
+    d->requested += cnt * size;
+    intr_set_level(old_level);
+    for (i = 0; i < cnt; i++)
+        heapprof_alloc(blocks[i], size, HEAPPROF_MALLOC,
+                       __builtin_return_address(0));
+    return cnt;
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -159,8 +344,10 @@ calloc(size_t a, size_t b)
 
     /* Allocate and zero memory. */
     p = malloc(size);
-    if (p != NULL)
+    if (p != NULL) {
         memset(p, 0, size);
+        heapprof_alloc(p, size, HEAPPROF_MALLOC, __builtin_return_address(0));
+    }
 
     return p;
 }
@@ -176,6 +363,42 @@ block_size(void *block)
     return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs(block);
 }
 
+/* Returns the number of bytes usable in BLOCK, which is at least
+   as many as were asked for, or 0 if BLOCK is a null pointer. */
+size_t malloc_usable_size(void *block)
+{
+    return block != NULL ? block_size(block) : 0;
+}
+
+/* Tries to make BLOCK hold NEW_SIZE bytes without moving it, and
+   returns true if successful.  A normal block stays put if
+   NEW_SIZE fits and would not leave more than half of it unused,
+   unless it is already in the smallest size class.  A big block
+   too big to become a normal one gives back or takes in pages at
+   its end, if they came from the page allocator and the pages
+   after it are free. */
+static bool
+resize_in_place(void *block, size_t new_size)
+{
+    struct arena *a = block_to_arena(block);
+    struct desc *d = a->desc;
+    size_t page_cnt;
+
+    if (d != NULL)
+        return (new_size <= d->block_size
+                && (new_size > d->block_size / 2 || d == descs));
+    if (find_desc(new_size) != NULL)
+        return false;
+
+    page_cnt = DIV_ROUND_UP(new_size + sizeof *a, PGSIZE);
+    if (page_cnt == a->free_cnt)
+        return true;
+    if (is_vmalloc_addr(a) || !palloc_resize(a, page_cnt))
+        return false;
+    a->free_cnt = page_cnt;
+    return true;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -188,6 +411,10 @@ realloc(void *old_block, size_t new_size)
     if (new_size == 0) {
         free(old_block);
         return NULL;
+    } else if (old_block != NULL && resize_in_place(old_block, new_size)) {
+        heapprof_alloc(old_block, new_size, HEAPPROF_MALLOC,
+                       __builtin_return_address(0));
+        return old_block;
     } else {
         void *new_block = malloc(new_size);
         if (old_block != NULL && new_block != NULL) {
@@ -196,6 +423,8 @@ realloc(void *old_block, size_t new_size)
             memcpy(new_block, old_block, min_size);
             free(old_block);
         }
+        heapprof_alloc(new_block, new_size, HEAPPROF_MALLOC,
+                       __builtin_return_address(0));
         return new_block;
     }
 }
@@ -204,10 +433,12 @@ realloc(void *old_block, size_t new_size)
    malloc(), calloc(), or realloc(). */
 void free(void *p)
 {
+    heapprof_free(p);
     if (p != NULL) {
         struct block *b = p;
         struct arena *a = block_to_arena(b);
         struct desc *d = a->desc;
+        struct malloc_cache *c;
 
         if (d != NULL) {
             /* It's a normal block.  We handle it here. */
@@ -217,30 +448,343 @@ void free(void *p)
             memset(b, 0xcc, d->block_size);
 #endif
 
-            lock_acquire(&d->lock);
+            /* Put the block in this thread's cache, first flushing
+               a batch of blocks from it if it is full. */
+            c = &thread_current()->malloc_cache;
+            if (c->cnt[d - descs] >= d->cache_size)
+                flush_cache(d, c, d->cache_batch);
+            b->next_free = c->blocks[d - descs];
+            c->blocks[d - descs] = b;
+            c->cnt[d - descs]++;
+        } else {
+            /* It's a big block.  Put it in its bin, first making
+               room by freeing the biggest cached blocks, or free
+               its pages if it cannot be cached. */
+            size_t page_cnt = a->free_cnt;
+
+            if (page_cnt > BIG_BINS) {
+                free_big_block(a);
+                return;
+            }
+            lock_acquire(&big_lock);
+            while (big_cached_pages + page_cnt > BIG_CACHE_PAGES) {
+                struct list *bin = &big_bins[BIG_BINS - 1];
+                struct arena *victim;
+
+                while (list_empty(bin))
+                    bin--;
+                victim = list_entry(list_pop_back(bin), struct arena,
+                                    partial_elem);
+                big_cached_pages -= victim->free_cnt;
+                free_big_block(victim);
+            }
+            list_push_front(&big_bins[page_cnt - 1], &a->partial_elem);
+            big_cached_pages += page_cnt;
+            lock_release(&big_lock);
+        }
+    }
+}
+
+/* Gives every block in the running thread's cache back to its
+   arena. */
+void malloc_flush(void)
+{
+    struct malloc_cache *c = &thread_current()->malloc_cache;
+    struct desc *d;
 
-            /* Add block to free list. */
-            list_push_front(&d->free_list, &b->free_elem);
+    for (d = descs; d < descs + desc_cnt; d++)
+        if (c->cnt[d - descs] != 0)
+            flush_cache(d, c, c->cnt[d - descs]);
+}
 
-            /* If the arena is now entirely unused, free it. */
-            if (++a->free_cnt >= d->blocks_per_arena) {
-                size_t i;
+/* Gives the pages of big block arena A back to where they came
+   from. */
+static void
+free_big_block(struct arena *a)
+{
+    if (is_vmalloc_addr(a))
+        vfree(a);
+    else
+        palloc_free_multiple(a, a->free_cnt);
+}
 
-                ASSERT(a->free_cnt == d->blocks_per_arena);
-                for (i = 0; i < d->blocks_per_arena; i++) {
-                    struct block *b = arena_to_block(a, i);
-                    list_remove(&b->free_elem);
-                }
-                palloc_free_page(a);
-            }
+/* Returns the smallest descriptor that satisfies a SIZE-byte
+   request, or a null pointer if SIZE is too big for any.  SIZE
+   must not be 0. */
+static struct desc *
+find_desc(size_t size)
+{
+    size_t idx;
+
+    if (size > sizeof size_class * CLASS_STEP)
+        return NULL;
+    idx = size_class[(size - 1) / CLASS_STEP];
+    return idx < desc_cnt ? descs + idx : NULL;
+}
+
+/* Takes a free block from D's first partial arena, creating a
+   new arena if there is none, and returns it.  Returns a null
+   pointer if no page is available for a new arena.  D's lock
+   must be held. */
+static struct block *
+take_block(struct desc *d)
+{
+    struct block *b;
+    struct arena *a;
 
-            lock_release(&d->lock);
+    ASSERT(lock_held_by_current_thread(&d->lock));
+
+    /* If there is no partial arena, create a new arena. */
+    if (list_empty(&d->partial)) {
+        size_t i;
+
+        /* Allocate a page, or reuse the spare.  Arenas come and go
+           with the blocks in them, so keep them with the other
+           short-lived pages. */
+        if (d->spare != NULL) {
+            a = d->spare;
+            d->spare = NULL;
         } else {
-            /* It's a big block.  Free its pages. */
-            palloc_free_multiple(a, a->free_cnt);
-            return;
+            a = palloc_get_page(PAL_SHORTLIVED);
+            if (a == NULL)
+                return NULL;
+        }
+
+        /* Initialize arena, link its blocks into its free list in
+           address order, and make it partial. */
+        a->magic = ARENA_MAGIC;
+        a->desc = d;
+        a->free_cnt = d->blocks_per_arena;
+        a->free = NULL;
+        for (i = d->blocks_per_arena; i-- > 0;) {
+            struct block *b = arena_to_block(a, i);
+            b->next_free = a->free;
+            a->free = b;
+        }
+        list_push_front(&d->partial, &a->partial_elem);
+    }
+
+    /* Get a block from the first partial arena. */
+    a = list_entry(list_front(&d->partial), struct arena, partial_elem);
+    b = a->free;
+    a->free = b->next_free;
+    if (--a->free_cnt == 0)
+        list_remove(&a->partial_elem);
+    return b;
+}
+
+/* Adds block B back to its arena's free list.  D, B's descriptor,
+   must have its lock held. */
+static void
+put_block(struct desc *d, struct block *b)
+{
+    struct arena *a = block_to_arena(b);
+
+    ASSERT(lock_held_by_current_thread(&d->lock));
+
+    b->next_free = a->free;
+    a->free = b;
+
+    /* If the arena is now entirely unused, keep it as the spare,
+       or free it if there already is one.  Otherwise move it
+       within the partial list, as described at the top of this
+       file. */
+    if (++a->free_cnt >= d->blocks_per_arena) {
+        ASSERT(a->free_cnt == d->blocks_per_arena);
+        list_remove(&a->partial_elem);
+        if (d->spare == NULL)
+            d->spare = a;
+        else
+            palloc_free_page(a);
+    } else if (a->free_cnt == 1)
+        list_push_front(&d->partial, &a->partial_elem);
+    else if (a->free_cnt == d->blocks_per_arena / 2) {
+        list_remove(&a->partial_elem);
+        list_push_back(&d->partial, &a->partial_elem);
+    }
+}
+
+/* Moves a batch of D's blocks into cache C, and returns the
+   number moved, which is 0 only if memory is not available. */
+static size_t
+refill_cache(struct desc *d, struct malloc_cache *c)
+{
+    size_t idx = d - descs;
+    size_t cnt;
+
+    lock_acquire(&d->lock);
+    d->lock_acquires++;
+    for (cnt = 0; cnt < d->cache_batch; cnt++) {
+        struct block *b = take_block(d);
+        if (b == NULL)
+            break;
+        b->next_free = c->blocks[idx];
+        c->blocks[idx] = b;
+    }
+    c->cnt[idx] += cnt;
+    d->cached += cnt;
+    lock_release(&d->lock);
+    return cnt;
+}
+
+/* Gives the top CNT of D's blocks in cache C back to their
+   arenas. */
+static void
+flush_cache(struct desc *d, struct malloc_cache *c, size_t cnt)
+{
+    size_t idx = d - descs;
+    size_t i;
+
+    ASSERT(cnt <= c->cnt[idx]);
+
+    lock_acquire(&d->lock);
+    d->lock_acquires++;
+    for (i = 0; i < cnt; i++) {
+        struct block *b = c->blocks[idx];
+        c->blocks[idx] = b->next_free;
+        put_block(d, b);
+    }
+    c->cnt[idx] -= cnt;
+    d->cached -= cnt;
+    lock_release(&d->lock);
+}
+
+/* Fills in ST with totals for every allocation made so far. */
+void malloc_stats(struct malloc_stats *st)
+{
+    struct desc *d;
+
+    st->allocs = st->requested = st->consumed = 0;
+    st->cached = st->lock_acquires = 0;
+    for (d = descs; d < descs + desc_cnt; d++) {
+        enum intr_level old_level;
+
+        lock_acquire(&d->lock);
+        st->cached += d->cached;
+        st->lock_acquires += d->lock_acquires;
+        lock_release(&d->lock);
+
+        old_level = intr_disable();
+        st->allocs += d->allocs;
+        st->requested += d->requested;
+        st->consumed += d->allocs * d->block_size;
+        intr_set_level(old_level);
+    }
+    lock_acquire(&big_lock);
+    st->allocs += big_allocs;
+    st->requested += big_requested;
+    st->consumed += big_pages * PGSIZE;
+    st->big_cache_hits = big_cache_hits;
+    st->big_cached_pages = big_cached_pages;
+    lock_release(&big_lock);
+}
+
+/* Fills in ST with totals for every allocation made so far,
+   reading the counters without locking.  Interrupts must be
+   off. */
+static void
+stats_snapshot(struct malloc_stats *st)
+{
+    struct desc *d;
+
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    st->allocs = st->requested = st->consumed = 0;
+    st->cached = st->lock_acquires = 0;
+    for (d = descs; d < descs + desc_cnt; d++) {
+        st->cached += d->cached;
+        st->lock_acquires += d->lock_acquires;
+        st->allocs += d->allocs;
+        st->requested += d->requested;
+        st->consumed += d->allocs * d->block_size;
+    }
+    st->allocs += big_allocs;
+    st->requested += big_requested;
+    st->consumed += big_pages * PGSIZE;
+    st->big_cache_hits = big_cache_hits;
+    st->big_cached_pages = big_cached_pages;
+}
+
+/* Prints how well each size class has fit the requests made of
+   it: the bytes asked for as a share of the bytes handed out.
+   This runs on the panic path, possibly with a descriptor's lock
+   or big_lock held by the thread that panicked, so it reads the
+   counters with interrupts off instead of locking. */
+void malloc_print_stats(void)
+{
+    struct malloc_stats st;
+    struct desc *d;
+    enum intr_level old_level;
+
+    old_level = intr_disable();
+    for (d = descs; d < descs + desc_cnt; d++)
+        if (d->allocs != 0)
+            printf("Malloc: %zu-byte blocks: %llu allocs, %llu%% used\n",
+                   d->block_size, d->allocs,
+                   d->requested * 100 / (d->allocs * d->block_size));
+    if (big_allocs != 0)
+        printf("Malloc: big blocks: %llu allocs, %llu%% used, "
+               "%llu from cache, %zu pages cached\n",
+               big_allocs, big_requested * 100 / (big_pages * PGSIZE),
+               big_cache_hits, big_cached_pages);
+
+    stats_snapshot(&st);
+    intr_set_level(old_level);
+    printf("Malloc: %llu allocs, %llu bytes requested, %llu bytes consumed\n",
+           st.allocs, st.requested, st.consumed);
+    printf("Malloc: %llu descriptor lock acquires, %llu blocks cached\n",
+           st.lock_acquires, st.cached);
+}
+
+/* Frees up to PAGE_CNT spare arenas, if POOL is the kernel pool,
+   and returns the number freed.  Skips descriptors whose lock is
+   held, since the allocation that ran out of pages may have been
+   made with it held. */
+static size_t
+shrink_spares(struct pool *pool, size_t page_cnt)
+{
+    struct desc *d;
+    size_t freed = 0;
+
+    if (pool != &kernel_pool)
+        return 0;
+    for (d = descs; d < descs + desc_cnt && freed < page_cnt; d++) {
+        if (lock_held_by_current_thread(&d->lock)
+            || !lock_try_acquire(&d->lock))
+            continue;
+        if (d->spare != NULL) {
+            palloc_free_page(d->spare);
+            d->spare = NULL;
+            freed++;
         }
+        lock_release(&d->lock);
     }
+    return freed;
+}
+
+/* Frees cached big blocks until PAGE_CNT pages have been freed
+   or the bins are empty, if POOL is the kernel pool, and returns
+   the number of pages freed.  Does nothing if big_lock is held,
+   for the same reason as shrink_spares(). */
+static size_t
+shrink_big_bins(struct pool *pool, size_t page_cnt)
+{
+    size_t freed = 0;
+    int i;
+
+    if (pool != &kernel_pool || lock_held_by_current_thread(&big_lock)
+        || !lock_try_acquire(&big_lock))
+        return 0;
+    for (i = BIG_BINS - 1; i >= 0 && freed < page_cnt; i--)
+        while (!list_empty(&big_bins[i]) && freed < page_cnt) {
+            struct arena *a = list_entry(list_pop_back(&big_bins[i]),
+                                         struct arena, partial_elem);
+            big_cached_pages -= a->free_cnt;
+            freed += a->free_cnt;
+            free_big_block(a);
+        }
+    lock_release(&big_lock);
+    return freed;
 }
 
 /* Returns the arena that block B is inside. */
@@ -4,10 +4,38 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Most size classes malloc() can have. */
+#define MALLOC_CLASS_MAX 16
+
+/* Free blocks that a thread keeps for itself, so that most of
+   its malloc() and free() calls need not take a descriptor lock.
+   The blocks of each size class are chained through their first
+   word.  Embedded in struct thread. */
+struct malloc_cache {
+    void *blocks[MALLOC_CLASS_MAX];      /* Top block of each class. */
+    unsigned char cnt[MALLOC_CLASS_MAX]; /* Blocks in each class. */
+};
+
+/* Heap usage totals, filled in by malloc_stats(). */
+struct malloc_stats {
+    unsigned long long allocs;    /* Allocations made. */
+    unsigned long long requested; /* Bytes asked for in them. */
+    unsigned long long consumed;  /* Bytes of blocks handed out. */
+    unsigned long long cached;    /* Free blocks in thread caches. */
+    unsigned long long lock_acquires; /* Times a descriptor lock was taken. */
+    unsigned long long big_cache_hits; /* Big blocks reused from cache. */
+    size_t big_cached_pages;      /* Pages of freed big blocks kept. */
+};
+
 void malloc_init(void);
 void *malloc(size_t) __attribute__((malloc));
 void *calloc(size_t, size_t) __attribute__((malloc));
 void *realloc(void *, size_t);
+size_t malloc_batch(size_t size, size_t cnt, void **blocks);
+size_t malloc_usable_size(void *);
 void free(void *);
+void malloc_flush(void);
+void malloc_stats(struct malloc_stats *);
+void malloc_print_stats(void);
 
 #endif /* threads/malloc.h */
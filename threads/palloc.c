@@ -2,11 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/heapprof.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,7 +27,35 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   The split is not fixed, though.  The kernel pool lies just
+   below the user pool, and a pool that runs out of pages borrows
+   whole chunks of free pages from the other across the boundary
+   between them, as long as the other keeps its floor.  Pages
+   borrowed this way stay with the borrower until the other pool
+   runs out and borrows them back.  To make this cheap, both
+   pools index pages from the same base, and each pool's
+   used_map and struct pages cover all of free memory, with the
+   pages outside the pool marked used.
+
+   When a pool cannot find the pages even after borrowing, it
+   asks the registered shrinkers to give back pages that other
+   subsystems cache, such as empty malloc() arenas, and tries
+   again. */
+
+/* Pages moved between the pools at a time. */
+#define CHUNK_PAGES 64
+
+/* Pages in a pageblock, the unit of lifetime grouping. */
+#define PAGEBLOCK_PAGES 16
+
+/* Whether PAL_SHORTLIVED and PAL_PINNED_LONG are heeded. */
+static bool grouping = true;
+
+/* Registered shrinkers, in increasing order of priority. */
+static struct list shrinkers;
+static struct lock shrinker_lock;
 
 /* A memory pool. */
 
@@ -31,20 +63,145 @@
 struct pool kernel_pool;
 struct pool user_pool;
 
-static enum palloc_mode current_palloc_mode = PAL_FIRST_FIT;
-
-static void init_pool (struct pool *, void *base, size_t page_cnt,
+static void *get_pages (enum palloc_flags, size_t page_cnt,
+                        size_t align_pages, const void *caller);
+static size_t pool_meta_size (size_t page_cnt);
+static void init_pool (struct pool *, void *meta, uint8_t *base,
+                       size_t page_cnt, size_t start, size_t end,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static struct pool *pool_of (void *page);
+static size_t reserve_holes (struct pool *);
+static bool pool_borrow (struct pool *, size_t page_cnt);
+static size_t boundary_run (struct pool *, size_t max);
+static size_t run_shrinkers (struct pool *, size_t page_cnt);
 
 static size_t find_first_fit (struct pool *pool, size_t page_cnt);
 static size_t find_next_fit (struct pool *pool, size_t page_cnt);
 static size_t find_best_fit (struct pool *pool, size_t page_cnt);
+static size_t find_tlsf_fit (struct pool *pool, size_t page_cnt);
+static size_t find_bitmap_aligned (struct pool *pool, size_t page_cnt,
+                                   size_t align);
+static size_t find_best_fit_aligned (struct pool *pool, size_t page_cnt,
+                                     size_t align);
+static size_t find_tlsf_fit_aligned (struct pool *pool, size_t page_cnt,
+                                     size_t align);
+
+static void extent_rebuild (struct pool *pool);
+static void extent_free (struct pool *pool, size_t page_idx,
+                         size_t page_cnt);
+static void buddy_free (struct pool *pool, size_t page_idx,
+                        size_t page_cnt);
+static void buddy_rebuild (struct pool *pool);
+static void buddy_claim (struct pool *pool, size_t page_idx,
+                         size_t page_cnt);
+static void rebuild_index (struct pool *pool);
+static void set_policy (struct pool *pool, enum palloc_mode mode);
+
+static unsigned flags_lifetime (enum palloc_flags);
+static void pool_snapshot (struct pool *, struct palloc_stats *);
+static size_t pool_alloc (struct pool *pool, size_t page_cnt,
+                          size_t align, unsigned lifetime);
+static void pool_free (struct pool *pool, size_t page_idx);
+static size_t pool_alloc_batch (struct pool *pool, size_t page_cnt,
+                                void **pages, unsigned lifetime);
+static size_t take_free (struct pool *pool, size_t start, size_t end,
+                         size_t page_cnt, void **pages);
+static void group_range (struct pool *pool, size_t *first, size_t *last);
+static size_t group_alloc (struct pool *pool, size_t page_cnt,
+                           unsigned lifetime);
+static void group_release (struct pool *pool, size_t page_idx,
+                           size_t page_cnt);
+static struct magazine *class_magazine (struct pool *pool,
+                                        unsigned lifetime);
+static size_t magazine_get (struct pool *pool, struct magazine *mag,
+                            unsigned lifetime, bool zero, bool *zeroed);
+static void magazine_put (struct pool *pool, struct magazine *mag,
+                          size_t page_idx);
+static size_t magazine_take (struct pool *pool, struct magazine *mag,
+                             bool zero, size_t page_cnt, void **pages);
+static size_t magazine_drain (struct pool *pool, struct magazine *mag,
+                              size_t page_cnt);
+static size_t magazine_flush (struct pool *pool);
+
+static void latency_add (struct palloc_latency *, uint64_t cycles);
 
 void palloc_set_mode (enum palloc_mode mode);
 
+/* Selects MODE for all later allocations from both pools.  See
+   palloc_set_pool_mode(). */
 void palloc_set_mode (enum palloc_mode mode) {
-    current_palloc_mode = mode;
+    palloc_set_pool_mode (&kernel_pool, mode);
+    palloc_set_pool_mode (&user_pool, mode);
+}
+
+/* Selects MODE for all later allocations from POOL.  This is
+   safe while pages are allocated: see set_policy(). */
+void
+palloc_set_pool_mode (struct pool *pool, enum palloc_mode mode)
+{
+    lock_acquire (&pool->lock);
+    set_policy (pool, mode);
+    lock_release (&pool->lock);
+}
+
+/* Returns the mode that POOL allocates with. */
+enum palloc_mode
+palloc_get_mode (const struct pool *pool)
+{
+    return pool->policy->mode;
+}
+
+/* Sets the fewest pages POOL keeps when lending pages to the
+   other pool to PAGE_CNT.  It does not take back pages already
+   lent. */
+void
+palloc_set_floor (struct pool *pool, size_t page_cnt)
+{
+    lock_acquire (&pool->lock);
+    pool->floor = page_cnt;
+    lock_release (&pool->lock);
+}
+
+/* Turns lifetime grouping on or off, for later allocations.
+   While it is off, PAL_SHORTLIVED and PAL_PINNED_LONG are
+   ignored. */
+void
+palloc_set_grouping (bool enable)
+{
+    grouping = enable;
+}
+
+/* Returns true if shrinker A_ has lower priority than B_. */
+static bool
+shrinker_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+    const struct shrinker *a = list_entry (a_, struct shrinker, elem);
+    const struct shrinker *b = list_entry (b_, struct shrinker, elem);
+
+    return a->priority < b->priority;
+}
+
+/* Adds S to the shrinkers called when an allocation fails,
+   after any already registered with the same priority. */
+void
+palloc_register_shrinker (struct shrinker *s)
+{
+    s->calls = 0;
+    s->reclaimed = 0;
+    lock_acquire (&shrinker_lock);
+    list_insert_ordered (&shrinkers, &s->elem, shrinker_less, NULL);
+    lock_release (&shrinker_lock);
+}
+
+/* Removes S, which must be registered, from the shrinkers. */
+void
+palloc_unregister_shrinker (struct shrinker *s)
+{
+    lock_acquire (&shrinker_lock);
+    list_remove (&s->elem);
+    lock_release (&shrinker_lock);
 }
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
@@ -56,16 +213,35 @@ palloc_init (size_t user_page_limit)
     uint8_t *free_start = ptov (1024 * 1024);
     uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
     size_t free_pages = (free_end - free_start) / PGSIZE;
-    size_t user_pages = free_pages / 2;
-    size_t kernel_pages;
+    size_t meta_size = pool_meta_size (free_pages);
+    size_t meta_pages = DIV_ROUND_UP (2 * meta_size, PGSIZE);
+    size_t user_pages, kernel_pages;
+    uint8_t *base;
+
+    /* Both pools' metadata goes at the start of free memory,
+       followed by the pages the pools share out. */
+    if (meta_pages > free_pages)
+        PANIC ("Not enough memory for page allocator bitmaps.");
+    free_pages -= meta_pages;
+    base = free_start + meta_pages * PGSIZE;
+
+    user_pages = free_pages / 2;
     if (user_pages > user_page_limit)
         user_pages = user_page_limit;
     kernel_pages = free_pages - user_pages;
 
-    /* Give half of memory to kernel, half to user. */
-    init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-    init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-               user_pages, "user pool");
+    /* Give half of memory to kernel, half to user.  If
+       USER_PAGE_LIMIT capped the user pool, it cannot borrow its
+       way past the cap either. */
+    init_pool (&kernel_pool, free_start, base, free_pages,
+               0, kernel_pages, "kernel pool");
+    init_pool (&user_pool, free_start + meta_size, base, free_pages,
+               kernel_pages, free_pages, "user pool");
+    if (user_pages < free_pages / 2)
+        user_pool.ceiling = user_pages;
+
+    list_init (&shrinkers);
+    lock_init (&shrinker_lock);
 }
 
 static size_t
@@ -102,47 +278,494 @@ find_next_fit (struct pool *pool, size_t page_cnt)
     return page_idx;
 }
 
+/* Best fit.
+
+   While a pool's policy is PAL_BEST_FIT, each maximal run of
+   free pages in a pool is an "extent", indexed in the pool's
+   EXTENTS tree by length and then by start.  The best fit for a
+   request of PAGE_CNT pages is the least extent that is at least
+   PAGE_CNT pages long, found in O(log n).
+
+   An extent is represented by the struct page of its first page,
+   which is marked PG_EXTENT and linked into the tree.  The
+   struct page of its last page is marked PG_EXTENT_TAIL.  Both
+   record the extent's length.  When pages are freed, the extents
+   right after and right before them are found through these
+   marks in O(1) and merged with them.  Like the buddy lists, the
+   tree is rebuilt from used_map whenever best fit is selected.
+
+   PAL_TLSF uses the same extents, but keeps them on segregated
+   free lists instead of the tree. */
+
+static void tlsf_init (struct pool *pool);
+static void tlsf_insert (struct pool *pool, struct page *e);
+static void tlsf_remove (struct pool *pool, struct page *e);
+
+/* Orders extents by length, then by start.  A struct page that
+   is not an extent, such as a lookup key, goes before every
+   extent of the same length. */
+static bool
+extent_less (const struct avl_elem *a_, const struct avl_elem *b_,
+             void *aux UNUSED)
+{
+    const struct page *a = avl_entry (a_, struct page, free.avl_elem);
+    const struct page *b = avl_entry (b_, struct page, free.avl_elem);
+
+    if (a->length != b->length)
+        return a->length < b->length;
+    if (!(a->flags & PG_EXTENT) || !(b->flags & PG_EXTENT))
+        return (b->flags & PG_EXTENT) && !(a->flags & PG_EXTENT);
+    return a < b;
+}
+
+/* Adds the LENGTH free pages at START to POOL as an extent. */
+static void
+extent_insert (struct pool *pool, size_t start, size_t length)
+{
+    struct page *e = &pool->pages[start];
+    struct page *tail = &pool->pages[start + length - 1];
+
+    e->flags |= PG_EXTENT;
+    e->length = length;
+    tail->flags |= PG_EXTENT_TAIL;
+    tail->length = length;
+    if (pool->policy->mode == PAL_TLSF)
+        tlsf_insert (pool, e);
+    else
+        avl_insert (&pool->extents, &e->free.avl_elem);
+}
+
+/* Removes extent E from POOL. */
+static void
+extent_remove (struct pool *pool, struct page *e)
+{
+    ASSERT (e->flags & PG_EXTENT);
+
+    if (pool->policy->mode == PAL_TLSF)
+        tlsf_remove (pool, e);
+    else
+        avl_delete (&pool->extents, &e->free.avl_elem);
+    e->flags &= ~PG_EXTENT;
+    e[e->length - 1].flags &= ~PG_EXTENT_TAIL;
+}
+
+/* Discards POOL's extents and rebuilds them from its used_map. */
+static void
+extent_rebuild (struct pool *pool)
+{
+    size_t pool_size = bitmap_size (pool->used_map);
+    size_t start = 0;
+
+    if (pool->policy->mode == PAL_TLSF)
+        tlsf_init (pool);
+    else
+        avl_init (&pool->extents, extent_less, NULL);
+    while ((start = bitmap_scan (pool->used_map, start, 1, false))
+           != BITMAP_ERROR)
+      {
+        size_t end = bitmap_scan (pool->used_map, start, 1, true);
+        if (end == BITMAP_ERROR)
+            end = pool_size;
+        extent_insert (pool, start, end - start);
+        start = end;
+      }
+}
+
+/* Returns the PAGE_CNT pages at PAGE_IDX in POOL to its extents,
+   merging them with the free extents on either side. */
+static void
+extent_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    size_t start = page_idx;
+    size_t length = page_cnt;
+
+    ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+
+    if (page_idx + page_cnt < bitmap_size (pool->used_map)
+        && (pool->pages[page_idx + page_cnt].flags & PG_EXTENT))
+      {
+        struct page *next = &pool->pages[page_idx + page_cnt];
+
+        length += next->length;
+        extent_remove (pool, next);
+      }
+    if (page_idx > 0 && (pool->pages[page_idx - 1].flags & PG_EXTENT_TAIL))
+      {
+        struct page *tail = &pool->pages[page_idx - 1];
+        struct page *prev = tail - (tail->length - 1);
+
+        start -= prev->length;
+        length += prev->length;
+        extent_remove (pool, prev);
+      }
+
+    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+    extent_insert (pool, start, length);
+}
+
+/* Allocates the PAGE_CNT pages at PAGE_IDX in POOL, which must
+   all lie within free extent E, and returns PAGE_IDX.  The rest
+   of E, before and after them, stays free. */
+static size_t
+extent_take_at (struct pool *pool, struct page *e, size_t page_idx,
+                size_t page_cnt)
+{
+    size_t start = e - pool->pages;
+    size_t end = start + e->length;
+
+    ASSERT (page_idx >= start && page_idx + page_cnt <= end);
+
+    extent_remove (pool, e);
+    if (page_idx > start)
+        extent_insert (pool, start, page_idx - start);
+    if (page_idx + page_cnt < end)
+        extent_insert (pool, page_idx + page_cnt,
+                       end - (page_idx + page_cnt));
+
+    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    return page_idx;
+}
+
+/* Allocates the first PAGE_CNT pages of free extent E in POOL,
+   which must have at least that many, and returns the index of
+   the first one.  The rest of E stays free. */
+static size_t
+extent_take (struct pool *pool, struct page *e, size_t page_cnt)
+{
+    return extent_take_at (pool, e, e - pool->pages, page_cnt);
+}
+
+/* Allocates the PAGE_CNT free pages at PAGE_IDX in POOL, out of
+   whichever free extent holds them.  The extent is found through
+   the tail of the free run that PAGE_IDX lies in. */
+static void
+extent_claim (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    size_t end = bitmap_scan (pool->used_map, page_idx, 1, true);
+    struct page *tail;
+
+    if (end == BITMAP_ERROR)
+        end = bitmap_size (pool->used_map);
+    tail = &pool->pages[end - 1];
+    ASSERT (tail->flags & PG_EXTENT_TAIL);
+    extent_take_at (pool, tail - (tail->length - 1), page_idx, page_cnt);
+}
+
 static size_t
 find_best_fit (struct pool *pool, size_t page_cnt)
 {
-    size_t best_idx = BITMAP_ERROR;
-    size_t best_size = SIZE_MAX;
-    size_t idx = 0;
+    struct page key;
+    struct avl_elem *found;
+
+    key.length = page_cnt;
+    key.flags = 0;
+    found = avl_lower_bound (&pool->extents, &key.free.avl_elem);
+    if (found == NULL)
+        return BITMAP_ERROR;
+    return extent_take (pool, avl_entry (found, struct page, free.avl_elem),
+                        page_cnt);
+}
+
+/* Two-level segregated fit (TLSF).
+
+   In PAL_TLSF mode an extent of N pages is kept on free list
+   tlsf_free[FL][SL]: FL picks the range of sizes between two
+   powers of two that N falls in, and SL picks one of TLSF_SL_CNT
+   equal parts of that range.  Extents shorter than TLSF_SL_CNT
+   pages each get a list of their own under FL 0.  tlsf_fl_map and
+   tlsf_sl_map record which lists are nonempty.
+
+   A request is rounded up to the smallest size of the next list,
+   so that any extent on that list or a later one is big enough,
+   and that list is found with two find-first-set operations.
+   Allocation is therefore O(1) and good fit: the extent chosen
+   is never more than about 1/TLSF_SL_CNT bigger than the request
+   needs, unless nothing closer is free.  Freeing goes through
+   extent_free() and is O(1) as well. */
+
+/* Returns the index of the most significant bit set in X, which
+   must be nonzero. */
+static inline unsigned
+fls_size (size_t x)
+{
+    return sizeof x * CHAR_BIT - 1 - __builtin_clzl (x);
+}
+
+/* Stores the TLSF free list for extents of PAGE_CNT pages into
+   *FL and *SL. */
+static void
+tlsf_mapping (size_t page_cnt, unsigned *fl, unsigned *sl)
+{
+    if (page_cnt < TLSF_SL_CNT)
+      {
+        *fl = 0;
+        *sl = page_cnt;
+      }
+    else
+      {
+        unsigned f = fls_size (page_cnt);
+        *fl = f - TLSF_SL_LOG2 + 1;
+        *sl = (page_cnt >> (f - TLSF_SL_LOG2)) - TLSF_SL_CNT;
+      }
+}
+
+/* Empties POOL's TLSF free lists. */
+static void
+tlsf_init (struct pool *pool)
+{
+    unsigned fl, sl;
+
+    for (fl = 0; fl < TLSF_FL_CNT; fl++)
+      {
+        for (sl = 0; sl < TLSF_SL_CNT; sl++)
+            list_init (&pool->tlsf_free[fl][sl]);
+        pool->tlsf_sl_map[fl] = 0;
+      }
+    pool->tlsf_fl_map = 0;
+}
+
+/* Adds extent E to POOL's TLSF free lists. */
+static void
+tlsf_insert (struct pool *pool, struct page *e)
+{
+    unsigned fl, sl;
+
+    tlsf_mapping (e->length, &fl, &sl);
+    list_push_front (&pool->tlsf_free[fl][sl], &e->free.list_elem);
+    pool->tlsf_sl_map[fl] |= 1u << sl;
+    pool->tlsf_fl_map |= 1u << fl;
+}
+
+/* Removes extent E from POOL's TLSF free lists. */
+static void
+tlsf_remove (struct pool *pool, struct page *e)
+{
+    unsigned fl, sl;
+
+    tlsf_mapping (e->length, &fl, &sl);
+    list_remove (&e->free.list_elem);
+    if (list_empty (&pool->tlsf_free[fl][sl]))
+      {
+        pool->tlsf_sl_map[fl] &= ~(1u << sl);
+        if (pool->tlsf_sl_map[fl] == 0)
+            pool->tlsf_fl_map &= ~(1u << fl);
+      }
+}
+
+/* Returns a free extent in POOL with at least PAGE_CNT pages, or
+   a null pointer if there is none that TLSF can find in O(1). */
+static struct page *
+tlsf_search (struct pool *pool, size_t page_cnt)
+{
+    size_t rounded = page_cnt;
+    unsigned fl, sl, map;
+    struct list *free_list;
+
+    if (page_cnt >= TLSF_SL_CNT)
+        rounded += ((size_t) 1 << (fls_size (page_cnt) - TLSF_SL_LOG2)) - 1;
+    if (rounded < page_cnt)
+        return NULL;
+    tlsf_mapping (rounded, &fl, &sl);
+    if (fl >= TLSF_FL_CNT)
+        return NULL;
+
+    /* First nonempty list at or after (FL, SL). */
+    map = pool->tlsf_sl_map[fl] & (~0u << sl);
+    if (map == 0)
+      {
+        map = fl + 1 < TLSF_FL_CNT ? pool->tlsf_fl_map & (~0u << (fl + 1)) : 0;
+        if (map == 0)
+            return NULL;
+        fl = __builtin_ctz (map);
+        map = pool->tlsf_sl_map[fl];
+      }
+    sl = __builtin_ctz (map);
+
+    free_list = &pool->tlsf_free[fl][sl];
+    return list_entry (list_front (free_list), struct page, free.list_elem);
+}
+
+static size_t
+find_tlsf_fit (struct pool *pool, size_t page_cnt)
+{
+    struct page *e = tlsf_search (pool, page_cnt);
+
+    return e != NULL ? extent_take (pool, e, page_cnt) : BITMAP_ERROR;
+}
+
+/* Aligned allocation.
+
+   palloc_get_aligned() wants PAGE_CNT pages whose first page is
+   aligned, in physical memory, on a multiple of ALIGN pages.
+   Each mode handles this its own way:
+
+     - First and next fit scan used_map for free pages at aligned
+       positions only, skipping straight past each used page they
+       run into.
+
+     - Best fit walks the extents from the smallest that is long
+       enough, and takes the first one that holds an aligned run.
+       Any extent of PAGE_CNT + ALIGN - 1 pages does, so the walk
+       stops there at the latest.
+
+     - TLSF looks up an extent of PAGE_CNT + ALIGN - 1 pages,
+       which is sure to hold an aligned run.
+
+     - The buddy system takes a block big enough to hold the run
+       at its aligned position inside it; see
+       buddy_system_alloc_aligned().
+
+   In every mode the pages around the aligned run go straight
+   back to the free pool. */
+
+/* Returns the least index at or after PAGE_IDX in POOL whose
+   page is aligned on ALIGN pages.  Kernel virtual addresses map
+   physical memory at PHYS_BASE, which is aligned far more
+   coarsely than any pool, so the virtual page number will do. */
+static size_t
+align_index (const struct pool *pool, size_t page_idx, size_t align)
+{
+    size_t page_no = pg_no (pool->base) + page_idx;
 
-    while (idx < bitmap_size(pool->used_map))
-    {
-        size_t free_start = bitmap_scan (pool->used_map, idx, 1, false);
-        if (free_start == BITMAP_ERROR)
+    return ROUND_UP (page_no, align) - pg_no (pool->base);
+}
+
+/* Returns the index of the first run of PAGE_CNT free pages in
+   POOL that starts at or after START and before END, and whose
+   first page is aligned on ALIGN pages, or BITMAP_ERROR if there
+   is none.  Only reads used_map. */
+static size_t
+scan_aligned (struct pool *pool, size_t start, size_t end,
+              size_t page_cnt, size_t align)
+{
+    size_t pool_size = bitmap_size (pool->used_map);
+    size_t page_idx = align_index (pool, start, align);
+
+    while (page_idx < end && page_cnt <= pool_size - page_idx)
+      {
+        size_t used = bitmap_scan (pool->used_map, page_idx, 1, true);
+        size_t free;
+
+        if (used == BITMAP_ERROR || used >= page_idx + page_cnt)
+            return page_idx;
+        free = bitmap_scan (pool->used_map, used, 1, false);
+        if (free == BITMAP_ERROR)
             break;
-        
-        /* 연속된 free page 개수 계산 */
-        size_t free_cnt = 0;
-        size_t current_idx = free_start;
-        while (current_idx < bitmap_size(pool->used_map) &&
-                !bitmap_test(pool->used_map, current_idx))
-        {
-            free_cnt++;
-            current_idx++;
-        }
-        
-        if (free_cnt >= page_cnt && free_cnt < best_size)
-        {
-            best_idx = free_start;
-            best_size = free_cnt;
-            
-            if (free_cnt == page_cnt)
-                break;
-        }
-        
-        idx = free_start + free_cnt;
-    }
-    
-    if (best_idx != BITMAP_ERROR)
-        bitmap_set_multiple (pool->used_map, best_idx, page_cnt, true);
-    
-    return best_idx;
+        page_idx = align_index (pool, free, align);
+      }
+    return BITMAP_ERROR;
+}
+
+/* First fit and next fit, aligned.  Next fit starts at the
+   pool's next_fit_start_idx and wraps around. */
+static size_t
+find_bitmap_aligned (struct pool *pool, size_t page_cnt, size_t align)
+{
+    size_t pool_size = bitmap_size (pool->used_map);
+    size_t start = pool->policy->mode == PAL_NEXT_FIT
+                   ? pool->next_fit_start_idx : 0;
+    size_t page_idx;
+
+    page_idx = scan_aligned (pool, start, pool_size, page_cnt, align);
+    if (page_idx == BITMAP_ERROR && start > 0)
+        page_idx = scan_aligned (pool, 0, start, page_cnt, align);
+    if (page_idx == BITMAP_ERROR)
+        return BITMAP_ERROR;
+
+    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    if (pool->policy->mode == PAL_NEXT_FIT)
+        pool->next_fit_start_idx = (page_idx + page_cnt < pool_size
+                                    ? page_idx + page_cnt : 0);
+    return page_idx;
+}
+
+/* Best fit, aligned. */
+static size_t
+find_best_fit_aligned (struct pool *pool, size_t page_cnt, size_t align)
+{
+    struct page key;
+    struct avl_elem *elem;
+
+    key.length = page_cnt;
+    key.flags = 0;
+    for (elem = avl_lower_bound (&pool->extents, &key.free.avl_elem);
+         elem != NULL; elem = avl_next (&pool->extents, elem))
+      {
+        struct page *e = avl_entry (elem, struct page, free.avl_elem);
+        size_t start = e - pool->pages;
+        size_t page_idx = align_index (pool, start, align);
+
+        if (page_idx - start + page_cnt <= e->length)
+            return extent_take_at (pool, e, page_idx, page_cnt);
+      }
+    return BITMAP_ERROR;
+}
+
+/* TLSF, aligned. */
+static size_t
+find_tlsf_fit_aligned (struct pool *pool, size_t page_cnt, size_t align)
+{
+    struct page *e;
+
+    if (page_cnt + (align - 1) < page_cnt)
+        return BITMAP_ERROR;
+    e = tlsf_search (pool, page_cnt + (align - 1));
+    if (e == NULL)
+        return BITMAP_ERROR;
+    return extent_take_at (pool, e,
+                           align_index (pool, e - pool->pages, align),
+                           page_cnt);
+}
+
+/* Allocation policies.
+
+   Each pool allocates through its own policy, a table of the
+   functions that implement one palloc mode, so that, say, the
+   kernel pool can use first fit for its mostly single-page
+   allocations while the user pool uses the buddy system.  A
+   policy's free block index lives in the pool fields for its
+   mode.  Every policy keeps used_map exact as well, which is
+   what set_policy() relies on to switch a live pool. */
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL by clearing their
+   bits in used_map, which is all that first and next fit keep. */
+static void
+bitmap_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+}
+
+/* Allocates the PAGE_CNT free pages at PAGE_IDX in POOL by
+   setting their bits in used_map. */
+static void
+bitmap_claim (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
 }
 
+static const struct palloc_policy first_fit_policy =
+  {"first fit", PAL_FIRST_FIT, find_first_fit, find_bitmap_aligned,
+   bitmap_claim, bitmap_free, NULL};
+static const struct palloc_policy next_fit_policy =
+  {"next fit", PAL_NEXT_FIT, find_next_fit, find_bitmap_aligned,
+   bitmap_claim, bitmap_free, NULL};
+static const struct palloc_policy best_fit_policy =
+  {"best fit", PAL_BEST_FIT, find_best_fit, find_best_fit_aligned,
+   extent_claim, extent_free, extent_rebuild};
+static const struct palloc_policy buddy_policy =
+  {"buddy", PAL_BUDDY, buddy_system_alloc, buddy_system_alloc_aligned,
+   buddy_claim, buddy_free, buddy_rebuild};
+static const struct palloc_policy tlsf_policy =
+  {"TLSF", PAL_TLSF, find_tlsf_fit, find_tlsf_fit_aligned,
+   extent_claim, extent_free, extent_rebuild};
+
+/* Policies, indexed by mode. */
+static const struct palloc_policy *const policies[PAL_MODE_CNT] =
+  {&first_fit_policy, &next_fit_policy, &best_fit_policy,
+   &buddy_policy, &tlsf_policy};
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -151,36 +774,88 @@ find_best_fit (struct pool *pool, size_t page_cnt)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+    return get_pages (flags, page_cnt, 1, __builtin_return_address (0));
+}
+
+/* Like palloc_get_multiple(), but the first page returned is
+   aligned, in physical memory, on a multiple of ALIGN_PAGES
+   pages, which must be a power of two.  For example, 16 pages
+   aligned on 16 pages make a 64 kB buffer on a 64 kB boundary. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt,
+                    size_t align_pages)
+{
+    return get_pages (flags, page_cnt, align_pages,
+                      __builtin_return_address (0));
+}
+
+/* Does the work of palloc_get_aligned(), recording the pages
+   with the heap profiler as allocated from CALLER, so that each
+   allocation is recorded once, from the caller of the public
+   entry point. */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt, size_t align_pages,
+           const void *caller)
 {
     struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+    struct magazine *mag;
+    unsigned lifetime;
     void *pages;
     size_t page_idx;
+    bool zeroed = false;
+    bool shrunk = false;
+
+    ASSERT (align_pages != 0 && (align_pages & (align_pages - 1)) == 0);
 
     if (page_cnt == 0)
         return NULL;
 
-    lock_acquire (&pool->lock);
+    lifetime = flags_lifetime (flags);
+    mag = (page_cnt == 1 && align_pages == 1
+           ? class_magazine (pool, lifetime) : NULL);
 
-   switch (current_palloc_mode)
-    {
-        case PAL_NEXT_FIT:
-            page_idx = find_next_fit (pool, page_cnt);
-            break;
-        case PAL_BEST_FIT:
-            page_idx = find_best_fit (pool, page_cnt);
-            break;
-        case PAL_BUDDY:
-            /* TODO: Buddy System 구현 */
-            page_idx = find_first_fit (pool, page_cnt);
-            break;
-        case PAL_FIRST_FIT:
-        default:
-            page_idx = find_first_fit (pool, page_cnt);
+    /* If neither POOL nor borrowing from the other pool has the
+       pages, ask the shrinkers for some and try once more. */
+    for (;;)
+      {
+        do
+          {
+            page_idx = BITMAP_ERROR;
+            if (mag != NULL)
+                page_idx = magazine_get (pool, mag, lifetime,
+                                         flags & PAL_ZERO, &zeroed);
+            if (page_idx == BITMAP_ERROR)
+              {
+                lock_acquire (&pool->lock);
+                if (mag == NULL)
+                    page_idx = pool_alloc (pool, page_cnt, align_pages,
+                                           lifetime);
+                if (page_idx == BITMAP_ERROR && magazine_flush (pool) > 0)
+                    page_idx = pool_alloc (pool, page_cnt, align_pages,
+                                           lifetime);
+                lock_release (&pool->lock);
+              }
+          }
+        while (page_idx == BITMAP_ERROR
+               && pool_borrow (pool, page_cnt + align_pages - 1));
+
+        if (page_idx != BITMAP_ERROR || shrunk
+            || run_shrinkers (pool, page_cnt + align_pages - 1) == 0)
             break;
-    }
+        shrunk = true;
+      }
+
+    if (page_idx == BITMAP_ERROR || shrunk)
+      {
+        lock_acquire (&pool->lock);
+        if (page_idx == BITMAP_ERROR)
+            pool->counters[pool->policy->mode].failures++;
+        else
+            pool->shrink_rescues++;
+        lock_release (&pool->lock);
+      }
 
-    lock_release (&pool->lock);
-   
     if (page_idx != BITMAP_ERROR)
         pages = pool->base + PGSIZE * page_idx;
     else
@@ -188,8 +863,9 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
     if (pages != NULL)
         {
-            if (flags & PAL_ZERO)
+            if ((flags & PAL_ZERO) && !zeroed)
                 memset (pages, 0, PGSIZE * page_cnt);
+            heapprof_alloc (pages, page_cnt, HEAPPROF_PALLOC, caller);
         }
     else
         {
@@ -209,39 +885,128 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 void *
 palloc_get_page (enum palloc_flags flags)
 {
-    return palloc_get_multiple (flags, 1);
+    return get_pages (flags, 1, 1, __builtin_return_address (0));
+}
+
+/* Obtains up to PAGE_CNT single pages, not necessarily next to
+   each other, stores their kernel virtual addresses in PAGES, and
+   returns the number obtained.  FLAGS are as for
+   palloc_get_page().  The pages cached in the magazine for the
+   request's class come first, zeroed ones first for PAL_ZERO.
+   The rest are taken from the free runs found in one pass over
+   the pool's used_map, under a single acquisition of the pool's
+   lock.  Only if that leaves the batch short are the rest
+   obtained one at a time, flushing the magazines, borrowing from
+   the other pool and calling the shrinkers as palloc_get_page()
+   does.  If PAL_ASSERT is set and fewer than PAGE_CNT pages are
+   available, the kernel panics. */
+size_t
+palloc_get_pages_batch (enum palloc_flags flags, size_t page_cnt,
+                        void **pages)
+{
+    struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+    unsigned lifetime = flags_lifetime (flags);
+    struct magazine *mag = class_magazine (pool, lifetime);
+    size_t zeroed = 0, cnt = 0, i;
+
+    if (mag != NULL)
+      {
+        if (flags & PAL_ZERO)
+            zeroed = cnt = magazine_take (pool, mag, true, page_cnt, pages);
+        cnt += magazine_take (pool, mag, false, page_cnt - cnt,
+                              pages + cnt);
+      }
+
+    if (cnt < page_cnt)
+      {
+        lock_acquire (&pool->lock);
+        cnt += pool_alloc_batch (pool, page_cnt - cnt, pages + cnt,
+                                 lifetime);
+        lock_release (&pool->lock);
+      }
+
+    for (i = 0; i < cnt; i++)
+      {
+        if ((flags & PAL_ZERO) && i >= zeroed)
+            memset (pages[i], 0, PGSIZE);
+        heapprof_alloc (pages[i], 1, HEAPPROF_PALLOC,
+                        __builtin_return_address (0));
+      }
+
+    while (cnt < page_cnt)
+      {
+        void *page = get_pages (flags & ~PAL_ASSERT, 1, 1,
+                                __builtin_return_address (0));
+        if (page == NULL)
+            break;
+        pages[cnt++] = page;
+      }
+
+    if (cnt < page_cnt && (flags & PAL_ASSERT))
+        PANIC ("palloc_get_pages_batch: out of pages");
+    return cnt;
+}
+
+/* Frees the PAGE_CNT pages in PAGES, each of which must have
+   been allocated on its own, as by palloc_get_page() or
+   palloc_get_pages_batch().  Null pointers in PAGES are skipped.
+   The pages go straight back to their pools' policies, under
+   one acquisition of each pool's lock for each run of pages from
+   the same pool, instead of through the magazines, which would
+   only have to drain them again. */
+void
+palloc_free_pages_batch (void **pages, size_t page_cnt)
+{
+    struct pool *locked = NULL;
+    size_t i;
+
+    for (i = 0; i < page_cnt; i++)
+      {
+        struct pool *pool;
+        size_t page_idx;
+
+        if (pages[i] == NULL)
+            continue;
+        ASSERT (pg_ofs (pages[i]) == 0);
+        pool = pool_of (pages[i]);
+        ASSERT (pool != NULL);
+        page_idx = pg_no (pages[i]) - pg_no (pool->base);
+        ASSERT (pool->pages[page_idx].flags & PG_HEAD);
+        ASSERT (!(pool->pages[page_idx].flags & PG_CACHED));
+        ASSERT (pool->pages[page_idx].length == 1);
+        heapprof_free (pages[i]);
+
+#ifndef NDEBUG
+        memset (pages[i], 0xcc, PGSIZE);
+#endif
+
+        if (pool != locked)
+          {
+            if (locked != NULL)
+                lock_release (&locked->lock);
+            lock_acquire (&pool->lock);
+            locked = pool;
+          }
+        pool_free (pool, page_idx);
+      }
+    if (locked != NULL)
+        lock_release (&locked->lock);
 }
 
-/* Frees the PAGE_CNT pages starting at PAGES. */
+/* Frees the PAGE_CNT pages starting at PAGES, which must be all
+   the pages of one earlier allocation. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt)
 {
-    struct pool *pool;
-    size_t page_idx;
-
     ASSERT (pg_ofs (pages) == 0);
     if (pages == NULL || page_cnt == 0)
         return;
 
-    if (page_from_pool (&kernel_pool, pages))
-       pool = &kernel_pool;
-    else if (page_from_pool (&user_pool, pages))
-       pool = &user_pool;
-    else
-       NOT_REACHED ();
-
-    page_idx = pg_no (pages) - pg_no (pool->base);
-
-   #ifndef NDEBUG
-      memset (pages, 0xcc, PGSIZE * page_cnt);
-   #endif
-
-    lock_acquire (&pool->lock);
-    
-    ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
-   
-    lock_release (&pool->lock);
+    ASSERT (pool_of (pages) != NULL);
+    ASSERT (pool_of (pages)->pages[pg_no (pages)
+                                   - pg_no (pool_of (pages)->base)].length
+            == page_cnt);
+    palloc_free (pages);
 }
 
 /* Frees the page at PAGE. */
@@ -251,75 +1016,1499 @@ palloc_free_page (void *page)
     palloc_free_multiple (page, 1);
 }
 
+/* Frees the allocation starting at PAGES, whatever its size.
+   The size is kept in the struct page of its first page.  A
+   single page goes into the magazine for its pageblock's class,
+   if that class has one, so that it is only handed out again for
+   the same class. */
 void
-buddy_system_free (struct pool *pool, void *pages)
+palloc_free (void *pages)
 {
-    if (pages == NULL || pool == NULL)
-        return;
-        
-    size_t page_idx = pg_no (pages) - pg_no (pool->base);
-    
+    struct pool *pool;
+    struct page *head;
+    struct magazine *mag;
+    size_t page_idx;
+
+    ASSERT (pg_ofs (pages) == 0);
+    if (pages == NULL)
+        return;
+
+    pool = pool_of (pages);
+    if (pool == NULL)
+        NOT_REACHED ();
+    heapprof_free (pages);
+
+    page_idx = pg_no (pages) - pg_no (pool->base);
+    head = &pool->pages[page_idx];
+    ASSERT (head->flags & PG_HEAD);
+    ASSERT (!(head->flags & PG_CACHED));
+
+   #ifndef NDEBUG
+      memset (pages, 0xcc, PGSIZE * head->length);
+   #endif
+
+    if (head->length == 1)
+      {
+        size_t block = ROUND_DOWN (page_idx, PAGEBLOCK_PAGES);
+        mag = class_magazine (pool, pool->pages[block].lifetime);
+      }
+    else
+        mag = NULL;
+    if (mag != NULL)
+        magazine_put (pool, mag, page_idx);
+    else
+      {
+        lock_acquire (&pool->lock);
+        pool_free (pool, page_idx);
+        lock_release (&pool->lock);
+      }
+}
+
+/* Changes the allocation starting at PAGES to NEW_CNT pages
+   without moving it, and returns true if successful.  Shrinking
+   frees the pages past the first NEW_CNT and always succeeds.
+   Growing succeeds only if the pages that follow the allocation
+   are free, in the same pool, and in pageblocks of the same
+   lifetime as its first page. */
+bool
+palloc_resize (void *pages, size_t new_cnt)
+{
+    struct pool *pool;
+    struct page *head;
+    size_t page_idx, old_cnt;
+    bool success = true;
+
+    ASSERT (pg_ofs (pages) == 0);
+    ASSERT (new_cnt > 0);
+
+    pool = pool_of (pages);
+    ASSERT (pool != NULL);
+    page_idx = pg_no (pages) - pg_no (pool->base);
+    head = &pool->pages[page_idx];
+    ASSERT (head->flags & PG_HEAD);
+
     lock_acquire (&pool->lock);
-    
-    size_t page_cnt = 1;
-    while (page_idx + page_cnt < bitmap_size(pool->used_map) &&
-           bitmap_test (pool->used_map, page_idx + page_cnt))
-    {
-        page_cnt++;
-    }
-    
-    ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
-    
+    old_cnt = head->length;
+    if (new_cnt < old_cnt)
+      {
+        pool->policy->free (pool, page_idx + new_cnt, old_cnt - new_cnt);
+        group_release (pool, page_idx + new_cnt, old_cnt - new_cnt);
+      }
+    else if (new_cnt > old_cnt)
+      {
+        uint8_t lifetime
+          = pool->pages[ROUND_DOWN (page_idx, PAGEBLOCK_PAGES)].lifetime;
+        size_t block;
+
+        success = (page_idx + new_cnt <= pool->end
+                   && bitmap_none (pool->used_map, page_idx + old_cnt,
+                                   new_cnt - old_cnt));
+        for (block = ROUND_UP (page_idx + old_cnt, PAGEBLOCK_PAGES);
+             success && block < page_idx + new_cnt;
+             block += PAGEBLOCK_PAGES)
+            if (pool->pages[block].lifetime != lifetime)
+                success = false;
+        if (success)
+            pool->policy->claim (pool, page_idx + old_cnt,
+                                 new_cnt - old_cnt);
+      }
+    if (success)
+        head->length = new_cnt;
     lock_release (&pool->lock);
+    if (success)
+        heapprof_resize (pages, new_cnt);
+    return success;
+}
+
+/* Calls the shrinkers, lowest priority first, until they have
+   given back PAGE_CNT pages to POOL, and returns the number of
+   pages they gave back.  The caller must not hold POOL's lock. */
+static size_t
+run_shrinkers (struct pool *pool, size_t page_cnt)
+{
+    struct list_elem *e;
+    size_t reclaimed = 0;
+
+    lock_acquire (&shrinker_lock);
+    for (e = list_begin (&shrinkers);
+         e != list_end (&shrinkers) && reclaimed < page_cnt;
+         e = list_next (e))
+      {
+        struct shrinker *s = list_entry (e, struct shrinker, elem);
+        size_t cnt = s->shrink (pool, page_cnt - reclaimed);
+
+        s->calls++;
+        s->reclaimed += cnt;
+        reclaimed += cnt;
+      }
+    lock_release (&shrinker_lock);
+
+    lock_acquire (&pool->lock);
+    pool->shrinks++;
+    pool->shrunk_pages += reclaimed;
+    lock_release (&pool->lock);
+    return reclaimed;
+}
+
+/* Returns the LT_* lifetime class that an allocation with FLAGS
+   should be grouped with. */
+static unsigned
+flags_lifetime (enum palloc_flags flags)
+{
+    if (grouping && (flags & PAL_SHORTLIVED))
+        return LT_SHORT;
+    else if (grouping && (flags & PAL_PINNED_LONG))
+        return LT_PINNED;
+    else
+        return LT_ANY;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, aligned on
+   ALIGN pages, and returns the index of the first one, or
+   BITMAP_ERROR if it cannot.  Unaligned allocations that fit in a
+   pageblock go in a pageblock for LIFETIME, if it is not LT_ANY
+   and there is room; everything else is placed by POOL's policy.
+   POOL's lock must be held. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt, size_t align,
+            unsigned lifetime)
+{
+    uint64_t start = rdtsc ();
+    size_t page_idx = BITMAP_ERROR;
+
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+
+    if (lifetime != LT_ANY && align == 1 && page_cnt <= PAGEBLOCK_PAGES)
+        page_idx = group_alloc (pool, page_cnt, lifetime);
+    if (page_idx == BITMAP_ERROR)
+        page_idx = (align > 1
+                    ? pool->policy->alloc_aligned (pool, page_cnt, align)
+                    : pool->policy->alloc (pool, page_cnt));
+
+    if (page_idx != BITMAP_ERROR)
+      {
+        pool->pages[page_idx].flags |= PG_HEAD;
+        pool->pages[page_idx].length = page_cnt;
+        latency_add (&pool->counters[pool->policy->mode].alloc,
+                     rdtsc () - start);
+      }
+    return page_idx;
+}
+
+/* Allocates up to PAGE_CNT single pages from POOL, stores their
+   addresses in PAGES, and returns the number allocated.  If
+   LIFETIME is not LT_ANY, the free pages in that class's
+   pageblocks are taken first, then those in wholly free
+   pageblocks, which join the class, as in group_alloc().  The
+   rest come from one pass over the whole pool.  Each run of free
+   pages is found with word-at-a-time bitmap scans and handed to
+   the policy's claim function in one piece, instead of searching
+   the policy once per page.  POOL's lock must be held. */
+static size_t
+pool_alloc_batch (struct pool *pool, size_t page_cnt, void **pages,
+                  unsigned lifetime)
+{
+    uint64_t start = rdtsc ();
+    size_t cnt = 0;
+
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+
+    if (lifetime != LT_ANY)
+      {
+        size_t first, last, i;
+        int pass;
+
+        group_range (pool, &first, &last);
+        for (pass = 0; pass < 2; pass++)
+            for (i = first; i < last && cnt < page_cnt;
+                 i += PAGEBLOCK_PAGES)
+              {
+                size_t block = (lifetime == LT_SHORT
+                                ? first + last - PAGEBLOCK_PAGES - i : i);
+                uint8_t *class = &pool->pages[block].lifetime;
+
+                if (pass == 0 && *class == lifetime)
+                    cnt += take_free (pool, block, block + PAGEBLOCK_PAGES,
+                                      page_cnt - cnt, pages + cnt);
+                else if (pass == 1 && *class == LT_ANY
+                         && bitmap_none (pool->used_map, block,
+                                         PAGEBLOCK_PAGES))
+                  {
+                    *class = lifetime;
+                    cnt += take_free (pool, block, block + PAGEBLOCK_PAGES,
+                                      page_cnt - cnt, pages + cnt);
+                  }
+              }
+      }
+    cnt += take_free (pool, pool->start, pool->end, page_cnt - cnt,
+                      pages + cnt);
+
+    if (cnt > 0)
+        latency_add (&pool->counters[pool->policy->mode].alloc,
+                     rdtsc () - start);
+    return cnt;
+}
+
+/* Allocates up to PAGE_CNT single pages from the free pages in
+   POOL between START and END, lowest first, stores their
+   addresses in PAGES, and returns the number allocated.  POOL's
+   lock must be held. */
+static size_t
+take_free (struct pool *pool, size_t start, size_t end, size_t page_cnt,
+           void **pages)
+{
+    size_t cnt = 0;
+
+    while (cnt < page_cnt && start < end)
+      {
+        size_t run, run_end, i;
+
+        run = bitmap_scan (pool->used_map, start, 1, false);
+        if (run == BITMAP_ERROR || run >= end)
+            break;
+        run_end = bitmap_scan (pool->used_map, run, 1, true);
+        if (run_end == BITMAP_ERROR || run_end > end)
+            run_end = end;
+        if (run_end - run > page_cnt - cnt)
+            run_end = run + (page_cnt - cnt);
+
+        pool->policy->claim (pool, run, run_end - run);
+        for (i = run; i < run_end; i++)
+          {
+            pool->pages[i].flags |= PG_HEAD;
+            pool->pages[i].length = 1;
+            pages[cnt++] = pool->base + PGSIZE * i;
+          }
+        start = run_end;
+      }
+    return cnt;
+}
+
+/* Frees the allocation at PAGE_IDX in POOL with POOL's policy.
+   POOL's lock must be held. */
+static void
+pool_free (struct pool *pool, size_t page_idx)
+{
+    struct page *head = &pool->pages[page_idx];
+    size_t page_cnt = head->length;
+    uint64_t start = rdtsc ();
+
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+    ASSERT (head->flags & PG_HEAD);
+
+    /* The policy may reuse HEAD's length for a free extent. */
+    pool->policy->free (pool, page_idx, page_cnt);
+    head->flags &= ~PG_HEAD;
+    group_release (pool, page_idx, page_cnt);
+    latency_add (&pool->counters[pool->policy->mode].free,
+                 rdtsc () - start);
+}
+
+/* Lifetime grouping.
+
+   Pages that are freed again soon, such as thread stacks, and
+   pages that never are, such as page tables, fragment a pool
+   badly if they are mixed: once the short-lived pages around
+   them are freed, the long-lived ones are left scattered through
+   the pool and break up the space that multi-page allocations
+   need.  So a pool is divided into aligned pageblocks of
+   PAGEBLOCK_PAGES pages, and a PAL_SHORTLIVED or PAL_PINNED_LONG
+   allocation goes in a pageblock set aside for its class.  When
+   all of a class's pageblocks are full, it takes a wholly free
+   pageblock: short-lived pages take the highest, pinned ones the
+   lowest, and the policies, which favor low addresses, place
+   everything else in between.  Classed pageblocks are kept within
+   the pool's floor, the part it never lends to the other pool
+   (see pool_borrow()), so that long-lived threads and arenas do
+   not pin the pages at the boundary.  A pageblock goes back to
+   being unclassed when its last page is freed.
+
+   Only the placement of a class's allocations is grouped.  Other
+   allocations can still land in a class's pageblocks, and when
+   there is no room in them or in a free pageblock, a classed
+   allocation falls back to the policy.
+
+   Short-lived single pages have a magazine of their own, refilled
+   from short-lived pageblocks, so that thread stacks and malloc()
+   arenas keep the lock-free and pre-zeroed paths.  Pinned single
+   pages bypass the magazines.  A single page is freed to the
+   magazine of its pageblock's class, so a page from a classed
+   pageblock is never handed out for another class. */
+
+/* Sets *FIRST and *LAST to the bounds of the whole pageblocks
+   within POOL's floor, where classed pageblocks are kept. */
+static void
+group_range (struct pool *pool, size_t *first, size_t *last)
+{
+    size_t size = pool->end - pool->start;
+    size_t keep = pool->floor < size ? pool->floor : size;
+    size_t lo = pool == &kernel_pool ? pool->start : pool->end - keep;
+
+    *first = ROUND_UP (lo, PAGEBLOCK_PAGES);
+    *last = ROUND_DOWN (lo + keep, PAGEBLOCK_PAGES);
+}
+
+/* Allocates PAGE_CNT pages, at most a pageblock's worth, from a
+   pageblock of class LIFETIME in POOL, and returns the index of
+   the first, or BITMAP_ERROR if no such pageblock or free
+   pageblock has room.  POOL's lock must be held. */
+static size_t
+group_alloc (struct pool *pool, size_t page_cnt, unsigned lifetime)
+{
+    size_t free_block = BITMAP_ERROR;
+    size_t first, last, i, page_idx;
+
+    group_range (pool, &first, &last);
+
+    /* Look at every whole pageblock within the floor, from the
+       top for short-lived pages and from the bottom for pinned
+       ones. */
+    for (i = first; i < last; i += PAGEBLOCK_PAGES)
+      {
+        size_t block = (lifetime == LT_SHORT
+                        ? first + last - PAGEBLOCK_PAGES - i : i);
+        uint8_t class = pool->pages[block].lifetime;
+
+        if (class == lifetime)
+          {
+            page_idx = scan_aligned (pool, block,
+                                     block + PAGEBLOCK_PAGES - page_cnt + 1,
+                                     page_cnt, 1);
+            if (page_idx != BITMAP_ERROR)
+              {
+                pool->policy->claim (pool, page_idx, page_cnt);
+                return page_idx;
+              }
+          }
+        else if (class == LT_ANY && free_block == BITMAP_ERROR
+                 && bitmap_none (pool->used_map, block, PAGEBLOCK_PAGES))
+            free_block = block;
+      }
+
+    if (free_block == BITMAP_ERROR)
+        return BITMAP_ERROR;
+    pool->pages[free_block].lifetime = lifetime;
+    pool->policy->claim (pool, free_block, page_cnt);
+    return free_block;
+}
+
+/* Returns each pageblock that the PAGE_CNT pages at PAGE_IDX in
+   POOL, just freed, overlap to LT_ANY if it is now wholly free.
+   POOL's lock must be held. */
+static void
+group_release (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    size_t block;
+
+    for (block = ROUND_DOWN (page_idx, PAGEBLOCK_PAGES);
+         block < page_idx + page_cnt; block += PAGEBLOCK_PAGES)
+        if (pool->pages[block].lifetime != LT_ANY
+            && bitmap_none (pool->used_map, block, PAGEBLOCK_PAGES))
+            pool->pages[block].lifetime = LT_ANY;
+}
+
+/* Magazines.
+
+   Each pool keeps a magazine of up to MAG_SIZE single pages that
+   are free as far as their users are concerned, but still
+   allocated as far as the pool's policy is concerned.
+   palloc_get_page() pops one and palloc_free_page() pushes one
+   with interrupts disabled but without the pool's lock.  An
+   empty magazine is refilled, and a full one drained, MAG_BATCH
+   pages at a time under a single acquisition of the lock.
+
+   While there is nothing else to run, the idle thread calls
+   palloc_zero_idle(), which zeroes pages from the magazines and
+   moves them to each magazine's stack of zeroed pages.  A
+   PAL_ZERO request takes a zeroed page first and skips its
+   memset().  Any other request takes one only if the magazine
+   itself is empty.
+
+   Each pool has two magazines: one for unclassed pages and one
+   for PAL_SHORTLIVED pages, described under "Lifetime grouping"
+   above.
+
+   An allocation that fails flushes the magazines, zeroed pages
+   included, and tries again, so cached pages never make an
+   allocation fail.  palloc_set_mode() also flushes every
+   magazine. */
+
+/* Returns POOL's magazine for single pages of class LIFETIME, or
+   a null pointer if that class has none. */
+static struct magazine *
+class_magazine (struct pool *pool, unsigned lifetime)
+{
+    if (lifetime == LT_ANY)
+        return &pool->mag;
+    else if (lifetime == LT_SHORT)
+        return &pool->short_mag;
+    else
+        return NULL;
+}
+
+/* Pops a page from the stack of CNT page indexes in STACK. */
+static size_t
+magazine_pop (struct pool *pool, size_t *stack, size_t *cnt)
+{
+    size_t page_idx = stack[--*cnt];
+
+    pool->pages[page_idx].flags &= ~PG_CACHED;
+    return page_idx;
+}
+
+/* Returns the index of a page from MAG, POOL's magazine for
+   pages of class LIFETIME, refilling it if it is empty, or
+   BITMAP_ERROR if POOL has no free page.  If ZERO is true,
+   prefers a page that is already zeroed.  Sets *ZEROED to whether
+   the page returned is known to be zero. */
+static size_t
+magazine_get (struct pool *pool, struct magazine *mag, unsigned lifetime,
+              bool zero, bool *zeroed)
+{
+    size_t batch[MAG_BATCH];
+    enum intr_level old_level;
+    size_t page_idx, cnt;
+
+    *zeroed = false;
+    old_level = intr_disable ();
+    if (zero)
+        mag->zero_gets++;
+    if (mag->zeroed_cnt > 0 && (zero || mag->cnt == 0))
+      {
+        page_idx = magazine_pop (pool, mag->zeroed, &mag->zeroed_cnt);
+        if (zero)
+            mag->zero_hits++;
+        mag->get_hits++;
+        intr_set_level (old_level);
+        *zeroed = true;
+        return page_idx;
+      }
+    if (mag->cnt > 0)
+      {
+        page_idx = magazine_pop (pool, mag->pages, &mag->cnt);
+        mag->get_hits++;
+        intr_set_level (old_level);
+        return page_idx;
+      }
+    mag->get_misses++;
+    intr_set_level (old_level);
+
+    /* Allocate a batch, keep the first page for the caller, and
+       stack up the rest so that the lowest comes out first. */
+    lock_acquire (&pool->lock);
+    for (cnt = 0; cnt < MAG_BATCH; cnt++)
+      {
+        batch[cnt] = pool_alloc (pool, 1, 1, lifetime);
+        if (batch[cnt] == BITMAP_ERROR)
+            break;
+      }
+    if (cnt == 0)
+      {
+        lock_release (&pool->lock);
+        return BITMAP_ERROR;
+      }
+
+    old_level = intr_disable ();
+    while (cnt > 1 && mag->cnt < MAG_SIZE)
+      {
+        page_idx = batch[--cnt];
+        pool->pages[page_idx].flags |= PG_CACHED;
+        mag->pages[mag->cnt++] = page_idx;
+      }
+    intr_set_level (old_level);
+    while (cnt > 1)
+        pool_free (pool, batch[--cnt]);
+    lock_release (&pool->lock);
+
+    return batch[0];
+}
+
+/* Pops up to PAGE_CNT pages from MAG, one of POOL's magazines,
+   stores their addresses in PAGES, and returns the number
+   popped.  Takes zeroed pages if ZERO is true, counting all
+   PAGE_CNT as requests for zeroed pages, otherwise the others. */
+static size_t
+magazine_take (struct pool *pool, struct magazine *mag, bool zero,
+               size_t page_cnt, void **pages)
+{
+    size_t *stack = zero ? mag->zeroed : mag->pages;
+    size_t *stack_cnt = zero ? &mag->zeroed_cnt : &mag->cnt;
+    enum intr_level old_level;
+    size_t cnt = 0;
+
+    old_level = intr_disable ();
+    while (cnt < page_cnt && *stack_cnt > 0)
+        pages[cnt++] = (pool->base
+                        + PGSIZE * magazine_pop (pool, stack, stack_cnt));
+    mag->get_hits += cnt;
+    if (zero)
+      {
+        mag->zero_gets += page_cnt;
+        mag->zero_hits += cnt;
+      }
+    intr_set_level (old_level);
+    return cnt;
+}
+
+/* Puts the single page at PAGE_IDX in POOL into MAG, one of
+   POOL's magazines, first draining MAG if it is full. */
+static void
+magazine_put (struct pool *pool, struct magazine *mag, size_t page_idx)
+{
+    enum intr_level old_level;
+
+    old_level = intr_disable ();
+    ASSERT (!(pool->pages[page_idx].flags & PG_CACHED));
+    if (mag->cnt < MAG_SIZE)
+      {
+        pool->pages[page_idx].flags |= PG_CACHED;
+        mag->pages[mag->cnt++] = page_idx;
+        mag->free_hits++;
+        intr_set_level (old_level);
+        return;
+      }
+    mag->free_misses++;
+    intr_set_level (old_level);
+
+    lock_acquire (&pool->lock);
+    magazine_drain (pool, mag, MAG_BATCH);
+    pool_free (pool, page_idx);
+    lock_release (&pool->lock);
+}
+
+/* Returns up to PAGE_CNT pages from the top of the stack of CNT
+   page indexes in STACK, part of POOL's magazine, to POOL, and
+   returns the number returned.  POOL's lock must be held. */
+static size_t
+drain_stack (struct pool *pool, size_t *stack, size_t *cnt,
+             size_t page_cnt)
+{
+    size_t batch[MAG_SIZE];
+    enum intr_level old_level;
+    size_t i;
+
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+
+    old_level = intr_disable ();
+    if (page_cnt > *cnt)
+        page_cnt = *cnt;
+    *cnt -= page_cnt;
+    memcpy (batch, stack + *cnt, page_cnt * sizeof *batch);
+    intr_set_level (old_level);
+
+    for (i = 0; i < page_cnt; i++)
+      {
+        pool->pages[batch[i]].flags &= ~PG_CACHED;
+        pool_free (pool, batch[i]);
+      }
+    return page_cnt;
+}
+
+/* Returns up to PAGE_CNT pages from the top of MAG, one of
+   POOL's magazines, to POOL, and returns the number returned.
+   POOL's lock must be held. */
+static size_t
+magazine_drain (struct pool *pool, struct magazine *mag, size_t page_cnt)
+{
+    return drain_stack (pool, mag->pages, &mag->cnt, page_cnt);
+}
+
+/* Returns every page in POOL's magazines, zeroed or not, to
+   POOL, and returns the number returned.  POOL's lock must be
+   held. */
+static size_t
+magazine_flush (struct pool *pool)
+{
+    struct magazine *mags[] = {&pool->mag, &pool->short_mag};
+    size_t i, cnt = 0;
+
+    for (i = 0; i < sizeof mags / sizeof *mags; i++)
+        cnt += (drain_stack (pool, mags[i]->pages, &mags[i]->cnt, MAG_SIZE)
+                + drain_stack (pool, mags[i]->zeroed, &mags[i]->zeroed_cnt,
+                               MAG_SIZE));
+    return cnt;
+}
+
+/* Zeroes one page from MAG, one of POOL's magazines, if it has
+   one and its stack of zeroed pages has room, and moves it to
+   that stack.  The page taken is the one at the bottom of the
+   stack, the least recently freed, so that the pages most likely
+   to be in the cache, and the order in which the others come
+   out, are left alone.  Returns true if it zeroed a page.
+
+   Interrupts stay off while the page is zeroed, which takes
+   about a microsecond, so that no other thread ever sees a page
+   that has left one stack but not yet joined the other, as a
+   drain would otherwise miss it. */
+static bool
+zero_one (struct pool *pool, struct magazine *mag)
+{
+    enum intr_level old_level;
+    size_t page_idx;
+
+    old_level = intr_disable ();
+    if (mag->cnt == 0 || mag->zeroed_cnt >= MAG_SIZE)
+      {
+        intr_set_level (old_level);
+        return false;
+      }
+    page_idx = mag->pages[0];
+    memmove (mag->pages, mag->pages + 1, --mag->cnt * sizeof *mag->pages);
+    memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+    mag->zeroed[mag->zeroed_cnt++] = page_idx;
+    mag->idle_zeroed++;
+    intr_set_level (old_level);
+    return true;
+}
+
+/* Zeroes one free page from one of the kernel or user pool's
+   magazines, for later PAL_ZERO requests.  Returns false if
+   there was nothing to zero.  Never blocks, so that the idle
+   thread can call it. */
+bool
+palloc_zero_idle (void)
+{
+    return (zero_one (&kernel_pool, &kernel_pool.mag)
+            || zero_one (&kernel_pool, &kernel_pool.short_mag)
+            || zero_one (&user_pool, &user_pool.mag)
+            || zero_one (&user_pool, &user_pool.short_mag));
+}
+
+/* Statistics.
+
+   Every pool_alloc() and pool_free() is timed with the CPU's
+   time-stamp counter, and the cycles it took are added to a log2
+   histogram kept for the pool's current mode.  Percentiles come from
+   these histograms, so they are only good to a power of two, but
+   keeping them takes constant time and space.  Single-page
+   allocations and frees served by a magazine never reach the
+   mode and are not timed.
+
+   The free page counts, largest extent and extent histogram
+   come from a scan of used_map at the time of the call. */
+
+/* Returns the index of the most significant bit set in X, or 0
+   if X is 0. */
+static unsigned
+log2_u64 (uint64_t x)
+{
+    uint32_t hi = x >> 32, lo = x;
+
+    if (hi != 0)
+        return 63 - __builtin_clz (hi);
+    else if (lo != 0)
+        return 31 - __builtin_clz (lo);
+    else
+        return 0;
+}
+
+/* Adds an operation that took CYCLES cycles to LAT. */
+static void
+latency_add (struct palloc_latency *lat, uint64_t cycles)
+{
+    unsigned k = log2_u64 (cycles);
+
+    lat->hist[k < PAL_LAT_BUCKETS ? k : PAL_LAT_BUCKETS - 1]++;
+    lat->cnt++;
+}
+
+/* Returns an upper bound on the PCT'th percentile of the
+   latencies in LAT, in cycles, or 0 if LAT is empty. */
+static unsigned long long
+latency_percentile (const struct palloc_latency *lat, unsigned pct)
+{
+    unsigned long long want = (lat->cnt * pct + 99) / 100;
+    unsigned long long seen = 0;
+    unsigned k;
+
+    if (lat->cnt == 0)
+        return 0;
+    for (k = 0; k < PAL_LAT_BUCKETS - 1; k++)
+      {
+        seen += lat->hist[k];
+        if (seen >= want)
+            break;
+      }
+    return 1ull << (k + 1);
+}
+
+/* Fills in ST with a snapshot of POOL. */
+void
+palloc_stats (struct pool *pool, struct palloc_stats *st)
+{
+    lock_acquire (&pool->lock);
+    pool_snapshot (pool, st);
+    lock_release (&pool->lock);
+}
+
+/* Fills in ST with a snapshot of POOL.  Either POOL's lock must
+   be held or interrupts must be off. */
+static void
+pool_snapshot (struct pool *pool, struct palloc_stats *st)
+{
+    size_t pool_size = bitmap_size (pool->used_map);
+    size_t start = 0;
+    size_t block;
+    enum intr_level old_level;
+    int mode;
+
+    memset (st, 0, sizeof *st);
+
+    while ((start = bitmap_scan (pool->used_map, start, 1, false))
+           != BITMAP_ERROR)
+      {
+        size_t end = bitmap_scan (pool->used_map, start, 1, true);
+        size_t length;
+        unsigned k;
+
+        if (end == BITMAP_ERROR)
+            end = pool_size;
+        length = end - start;
+        k = log2_u64 (length);
+
+        st->free_pages += length;
+        st->extent_cnt++;
+        st->extent_hist[k < PAL_HIST_CNT ? k : PAL_HIST_CNT - 1]++;
+        if (length > st->largest_free)
+            st->largest_free = length;
+        start = end;
+      }
+
+    old_level = intr_disable ();
+    st->cached_pages = (pool->mag.cnt + pool->mag.zeroed_cnt
+                        + pool->short_mag.cnt + pool->short_mag.zeroed_cnt);
+    intr_set_level (old_level);
+    st->free_pages += st->cached_pages;
+    st->reserved_pages = pool->reserved;
+    st->used_pages = (pool->end - pool->start - st->free_pages
+                      - pool->reserved);
+    for (block = ROUND_UP (pool->start, PAGEBLOCK_PAGES);
+         block + PAGEBLOCK_PAGES <= pool->end; block += PAGEBLOCK_PAGES)
+        if (pool->pages[block].lifetime == LT_SHORT)
+            st->short_blocks++;
+        else if (pool->pages[block].lifetime == LT_PINNED)
+            st->pinned_blocks++;
+    st->borrows = pool->borrows;
+    st->borrowed_pages = pool->borrowed_pages;
+    st->loans = pool->loans;
+    st->lent_pages = pool->lent_pages;
+    st->shrinks = pool->shrinks;
+    st->shrunk_pages = pool->shrunk_pages;
+    st->shrink_rescues = pool->shrink_rescues;
+
+    for (mode = 0; mode < PAL_MODE_CNT; mode++)
+      {
+        const struct palloc_counters *c = &pool->counters[mode];
+
+        st->modes[mode].allocs = c->alloc.cnt;
+        st->modes[mode].frees = c->free.cnt;
+        st->modes[mode].failures = c->failures;
+        st->modes[mode].alloc_p50 = latency_percentile (&c->alloc, 50);
+        st->modes[mode].alloc_p90 = latency_percentile (&c->alloc, 90);
+        st->modes[mode].alloc_p99 = latency_percentile (&c->alloc, 99);
+        st->modes[mode].free_p50 = latency_percentile (&c->free, 50);
+        st->modes[mode].free_p90 = latency_percentile (&c->free, 90);
+        st->modes[mode].free_p99 = latency_percentile (&c->free, 99);
+      }
+}
+
+/* Prints statistics for POOL, named NAME.  This runs on the
+   panic path, possibly with POOL's lock held or in an interrupt
+   handler, so it takes its snapshot with interrupts off instead
+   of locking. */
+static void
+print_pool_stats (struct pool *pool, const char *name)
+{
+    const struct magazine *mag = &pool->mag;
+    const struct magazine *short_mag = &pool->short_mag;
+    struct palloc_stats st;
+    enum intr_level old_level;
+    int mode, k;
+
+    old_level = intr_disable ();
+    pool_snapshot (pool, &st);
+    intr_set_level (old_level);
+    printf ("Palloc: %s %zu pages free (%zu cached), %zu used, "
+            "%zu reserved, largest free extent %zu pages\n", name,
+            st.free_pages, st.cached_pages, st.used_pages,
+            st.reserved_pages, st.largest_free);
+    printf ("Palloc: %s %zu free extents by size:", name, st.extent_cnt);
+    for (k = 0; k < PAL_HIST_CNT; k++)
+        if (st.extent_hist[k] != 0)
+            printf (" %zu%s:%zu", (size_t) 1 << k,
+                    k == PAL_HIST_CNT - 1 ? "+" : "", st.extent_hist[k]);
+    printf ("\n");
+    printf ("Palloc: %s %zu short-lived and %zu pinned pageblocks\n",
+            name, st.short_blocks, st.pinned_blocks);
+
+    for (mode = 0; mode < PAL_MODE_CNT; mode++)
+      if (st.modes[mode].allocs != 0 || st.modes[mode].frees != 0
+          || st.modes[mode].failures != 0)
+        printf ("Palloc: %s %s: %llu allocs (p50/p90/p99 %llu/%llu/%llu "
+                "cycles), %llu frees (%llu/%llu/%llu), %llu failures\n",
+                name, policies[mode]->name, st.modes[mode].allocs,
+                st.modes[mode].alloc_p50, st.modes[mode].alloc_p90,
+                st.modes[mode].alloc_p99, st.modes[mode].frees,
+                st.modes[mode].free_p50, st.modes[mode].free_p90,
+                st.modes[mode].free_p99, st.modes[mode].failures);
+
+    printf ("Palloc: %s magazine %llu gets (%llu hit), "
+            "%llu frees (%llu hit)\n", name,
+            mag->get_hits + mag->get_misses, mag->get_hits,
+            mag->free_hits + mag->free_misses, mag->free_hits);
+    printf ("Palloc: %s short-lived magazine %llu gets (%llu hit), "
+            "%llu frees (%llu hit)\n", name,
+            short_mag->get_hits + short_mag->get_misses,
+            short_mag->get_hits,
+            short_mag->free_hits + short_mag->free_misses,
+            short_mag->free_hits);
+    printf ("Palloc: %s %llu pages zeroed when idle, "
+            "%llu PAL_ZERO gets (%llu pre-zeroed)\n", name,
+            mag->idle_zeroed + short_mag->idle_zeroed,
+            mag->zero_gets + short_mag->zero_gets,
+            mag->zero_hits + short_mag->zero_hits);
+    printf ("Palloc: %s borrowed %llu pages in %llu transfers, "
+            "lent %llu pages in %llu transfers\n", name,
+            st.borrowed_pages, st.borrows, st.lent_pages, st.loans);
+    printf ("Palloc: %s shrinkers ran %llu times, reclaimed %llu pages, "
+            "rescued %llu allocations\n", name,
+            st.shrinks, st.shrunk_pages, st.shrink_rescues);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+    struct list_elem *e;
+    enum intr_level old_level;
+
+    print_pool_stats (&kernel_pool, "kernel pool");
+    print_pool_stats (&user_pool, "user pool");
+
+    /* Like print_pool_stats(), walk the shrinkers with interrupts
+       off rather than under shrinker_lock, which a panic inside a
+       shrinker leaves held. */
+    old_level = intr_disable ();
+    for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+         e = list_next (e))
+      {
+        struct shrinker *s = list_entry (e, struct shrinker, elem);
+
+        printf ("Palloc: shrinker %s (priority %d) called %llu times, "
+                "reclaimed %llu pages\n",
+                s->name, s->priority, s->calls, s->reclaimed);
+      }
+    intr_set_level (old_level);
+}
+
+/* Buddy system.
+
+   While a pool's policy is PAL_BUDDY, every free page of it
+   belongs to exactly one free block: a run of 2**K pages, for
+   some order K between 0 and MAX_ORDER, whose index within the
+   pool is a multiple of 2**K.  (Indexes here count from the
+   pool's current first page, pool->start, so blocks line up
+   again whenever the pool's boundary moves and buddy_rebuild()
+   runs.)  Free blocks of order K are kept
+   on the pool's free_area[K] list, and bit K of free_area_mask
+   says whether that list is nonempty.  A free block is linked
+   into its list through the struct page of its first page,
+   which is marked PG_BUDDY and records the block's order.
+
+   An allocation looks at the front block of each list that is
+   big enough and takes the one at the lowest address, which
+   keeps allocations packed toward the bottom of the pool the
+   way first fit does.  It splits that block in half until it is
+   just big enough, and hands the unused tail straight back.  A free
+   returns the pages block by block, merging each block with its
+   buddy for as long as the buddy is free.  Both take
+   O(MAX_ORDER) steps.
+
+   A block's buddy is free exactly when the buddy's struct page
+   is marked PG_BUDDY with the same order, so merging never looks
+   at used_map or touches the free pages.  used_map is still kept
+   exact in this mode: it lets the other modes take over at any
+   time, and it is where buddy_rebuild() gets the free lists
+   from. */
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to POOL's free
+   lists, without trying to merge it. */
+static void
+buddy_push (struct pool *pool, size_t page_idx, unsigned order)
+{
+    struct page *b = &pool->pages[page_idx];
+
+    b->flags |= PG_BUDDY;
+    b->order = order;
+    list_push_front (&pool->free_area[order], &b->free.list_elem);
+    pool->free_area_mask |= 1u << order;
+}
+
+/* Removes free block B from POOL's free lists. */
+static void
+buddy_remove (struct pool *pool, struct page *b)
+{
+    ASSERT (b->flags & PG_BUDDY);
+
+    list_remove (&b->free.list_elem);
+    b->flags &= ~PG_BUDDY;
+    if (list_empty (&pool->free_area[b->order]))
+        pool->free_area_mask &= ~(1u << b->order);
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy as many times as possible. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, unsigned order)
+{
+    size_t rel_idx = page_idx - pool->start;
+
+    bitmap_set_multiple (pool->used_map, page_idx, (size_t) 1 << order,
+                         false);
+    while (order < MAX_ORDER)
+      {
+        size_t buddy_idx = pool->start + (rel_idx ^ ((size_t) 1 << order));
+        struct page *buddy;
+
+        if (buddy_idx + ((size_t) 1 << order) > pool->end)
+            break;
+        buddy = &pool->pages[buddy_idx];
+        if (!(buddy->flags & PG_BUDDY) || buddy->order != order)
+            break;
+
+        buddy_remove (pool, buddy);
+        rel_idx &= ~((size_t) 1 << order);
+        order++;
+      }
+    buddy_push (pool, pool->start + rel_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, which need not
+   form a single buddy block, by splitting them into the largest
+   aligned blocks possible. */
+static void
+buddy_free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    while (page_cnt > 0)
+      {
+        unsigned order = 0;
+
+        while (order < MAX_ORDER
+               && (((page_idx - pool->start) >> order) & 1) == 0
+               && ((size_t) 2 << order) <= page_cnt)
+            order++;
+
+        buddy_free_block (pool, page_idx, order);
+        page_idx += (size_t) 1 << order;
+        page_cnt -= (size_t) 1 << order;
+      }
+}
+
+/* Discards POOL's buddy free lists and rebuilds them from its
+   used_map.  Free runs are carved into blocks from the top down,
+   so that the lowest block of each order ends up at the front of
+   its list. */
+static void
+buddy_rebuild (struct pool *pool)
+{
+    size_t end = pool->end;
+    unsigned order;
+
+    for (order = 0; order <= MAX_ORDER; order++)
+        list_init (&pool->free_area[order]);
+    pool->free_area_mask = 0;
+
+    while (end > pool->start)
+      {
+        size_t start = end;
+
+        if (bitmap_test (pool->used_map, end - 1))
+          {
+            end--;
+            continue;
+          }
+        while (start > pool->start
+               && !bitmap_test (pool->used_map, start - 1))
+            start--;
+
+        while (end > start)
+          {
+            order = 0;
+            while (order < MAX_ORDER
+                   && (((end - pool->start) >> order) & 1) == 0
+                   && ((size_t) 2 << order) <= end - start)
+                order++;
+            end -= (size_t) 1 << order;
+            buddy_push (pool, end, order);
+          }
+      }
+}
+
+/* Takes a free block of 2**ORDER pages from POOL, splitting a
+   bigger one if necessary, marks all of its pages used, and
+   returns it, or a null pointer if no free block is big enough.
+   Of the blocks at the front of each big enough list, takes the
+   one at the lowest address. */
+static struct page *
+buddy_take (struct pool *pool, unsigned order)
+{
+    struct page *b;
+    unsigned mask, k;
+    size_t page_idx;
+
+    mask = pool->free_area_mask >> order << order;
+    if (mask == 0)
+        return NULL;
+    b = NULL;
+    for (; mask != 0; mask &= mask - 1)
+      {
+        struct list *free_list = &pool->free_area[__builtin_ctz (mask)];
+        struct page *front = list_entry (list_front (free_list),
+                                         struct page, free.list_elem);
+        if (b == NULL || front < b)
+            b = front;
+      }
+    k = b->order;
+    page_idx = b - pool->pages;
+    buddy_remove (pool, b);
+
+    /* Split off upper halves until the block is just big enough. */
+    while (k > order)
+      {
+        k--;
+        buddy_push (pool, page_idx + ((size_t) 1 << k), k);
+      }
+
+    ASSERT (bitmap_none (pool->used_map, page_idx, (size_t) 1 << order));
+    bitmap_set_multiple (pool->used_map, page_idx, (size_t) 1 << order, true);
+    return b;
+}
+
+/* Marks the PAGE_CNT free pages at PAGE_IDX in POOL used, taking
+   them out of whatever free blocks they lie in.  The rest of
+   each such block goes back on the free lists. */
+static void
+buddy_claim (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    size_t end = page_idx + page_cnt;
+    size_t i = page_idx;
+
+    ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+    bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+
+    while (i < end)
+      {
+        size_t block = i;
+        unsigned order;
+
+        /* Find the free block that page I lies in. */
+        for (order = 0; order <= MAX_ORDER; order++)
+          {
+            block = pool->start + ((i - pool->start)
+                                   & ~(((size_t) 1 << order) - 1));
+            if ((pool->pages[block].flags & PG_BUDDY)
+                && pool->pages[block].order == order)
+                break;
+          }
+        ASSERT (order <= MAX_ORDER);
+        buddy_remove (pool, &pool->pages[block]);
+
+        /* Give back the parts of it outside the claimed pages. */
+        if (block < page_idx)
+            buddy_free_range (pool, block, page_idx - block);
+        i = block + ((size_t) 1 << order);
+        if (i > end)
+            buddy_free_range (pool, end, i - end);
+      }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL with the buddy
+   system and returns the index of the first one, or BITMAP_ERROR
+   if no free block is big enough.  POOL's lock must be held. */
+size_t
+buddy_system_alloc (struct pool *pool, size_t page_cnt)
+{
+    struct page *b;
+    unsigned order = 0;
+    size_t page_idx;
+
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+
+    while (((size_t) 1 << order) < page_cnt)
+        if (++order > MAX_ORDER)
+            return BITMAP_ERROR;
+
+    b = buddy_take (pool, order);
+    if (b == NULL)
+        return BITMAP_ERROR;
+    page_idx = b - pool->pages;
+
+    /* Give back the unused tail. */
+    buddy_free_range (pool, page_idx + page_cnt,
+                      ((size_t) 1 << order) - page_cnt);
+
+    return page_idx;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL with the buddy
+   system, the first of them aligned on ALIGN pages, and returns
+   its index, or BITMAP_ERROR if it cannot.  POOL's lock must be
+   held.
+
+   Blocks are aligned on their size by index within the pool, but
+   the pool itself need not be aligned.  So this takes a block of
+   at least ALIGN pages, which holds an aligned page at the same
+   offset PHASE from its start as every other such block, and big
+   enough to hold the run there.  The pages before and after the
+   run go back on the free lists.  If no such block exists, or it
+   would be bigger than the largest order, it falls back to
+   scanning used_map for an aligned free run and claiming it from
+   whatever free blocks it spans. */
+size_t
+buddy_system_alloc_aligned (struct pool *pool, size_t page_cnt,
+                            size_t align)
+{
+    size_t phase = align_index (pool, pool->start, align) - pool->start;
+    size_t need = phase + page_cnt > align ? phase + page_cnt : align;
+    unsigned order = 0;
+    size_t page_idx;
+    struct page *b;
+
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+
+    while (order <= MAX_ORDER && ((size_t) 1 << order) < need)
+        order++;
+    b = order <= MAX_ORDER ? buddy_take (pool, order) : NULL;
+    if (b != NULL)
+      {
+        size_t block = b - pool->pages;
+
+        page_idx = block + phase;
+        buddy_free_range (pool, block, phase);
+        buddy_free_range (pool, page_idx + page_cnt,
+                          ((size_t) 1 << order) - phase - page_cnt);
+        return page_idx;
+      }
+
+    page_idx = scan_aligned (pool, pool->start, pool->end, page_cnt, align);
+    if (page_idx != BITMAP_ERROR)
+        buddy_claim (pool, page_idx, page_cnt);
+    return page_idx;
+}
+
+/* Returns the allocation starting at PAGES, whose size is taken
+   from its struct page, to POOL's buddy free lists.  The pages
+   need not have been allocated by the buddy system.  POOL's lock
+   must be held. */
+void
+buddy_system_free (struct pool *pool, void *pages)
+{
+    struct page *head;
+    size_t page_idx;
+
+    if (pages == NULL || pool == NULL)
+        return;
+
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+
+    page_idx = pg_no (pages) - pg_no (pool->base);
+    head = &pool->pages[page_idx];
+    ASSERT (head->flags & PG_HEAD);
+    buddy_free (pool, page_idx, head->length);
+}
+
+/* Returns the PAGE_CNT pages at PAGE_IDX in POOL to its buddy
+   free lists. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+    ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+    buddy_free_range (pool, page_idx, page_cnt);
+}
+
+/* Rebuilds POOL's free block index for its policy, if the
+   policy has one, from its used_map.  POOL's lock must be held,
+   unless POOL is still being initialized. */
+static void
+rebuild_index (struct pool *pool)
+{
+    size_t pool_size = bitmap_size (pool->used_map);
+    size_t i;
+
+    for (i = 0; i < pool_size; i++)
+        pool->pages[i].flags &= PG_HEAD | PG_CACHED;
+
+    if (pool->policy->rebuild != NULL)
+        pool->policy->rebuild (pool);
+}
+
+/* Switches POOL to the policy for MODE.  The pages cached in
+   POOL's magazine go back to it first, under the old policy.
+   Then the new policy's free block index is rebuilt from
+   used_map, which every policy keeps exact, so pages allocated
+   under the old policy can be freed under the new one.  POOL's
+   lock must be held. */
+static void
+set_policy (struct pool *pool, enum palloc_mode mode)
+{
+    ASSERT (lock_held_by_current_thread (&pool->lock));
+    ASSERT ((unsigned) mode < PAL_MODE_CNT);
+
+    magazine_flush (pool);
+    if (pool->policy != policies[mode])
+      {
+        pool->policy = policies[mode];
+        rebuild_index (pool);
+      }
 }
 
 size_t
 palloc_get_page_index (void *page)
 {
-    struct pool *pool;
-    
-    if (page_from_pool (&kernel_pool, page))
-        pool = &kernel_pool;
-    else if (page_from_pool (&user_pool, page))
-        pool = &user_pool;
-    else
+    struct pool *pool = pool_of (page);
+
+    if (pool == NULL)
         return 0;
     
-    return pg_no (page) - pg_no (pool->base);
+    return pg_no (page) - pg_no (pool->base) - pool->start;
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
-static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
+/* Returns the bytes of metadata a pool needs to cover PAGE_CNT
+   pages: its used_map, followed by the used_map's summary and
+   then a struct page for each page. */
+static size_t
+pool_meta_size (size_t page_cnt)
 {
-    /* We'll put the pool's used_map at its base.
-       Calculate the space needed for the bitmap
-       and subtract it from the pool's size. */
-    size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-    if (bm_pages > page_cnt)
-        PANIC ("Not enough memory in %s for bitmap.", name);
-    page_cnt -= bm_pages;
+    return ROUND_UP (bitmap_buf_size (page_cnt)
+                     + bitmap_summary_buf_size (page_cnt)
+                     + page_cnt * sizeof (struct page), sizeof (void *));
+}
 
-    printf ("%zu pages available in %s.\n", page_cnt, name);
+/* Initializes pool P as owning pages START through END - 1 of
+   the PAGE_CNT pages at BASE, naming it NAME for debugging
+   purposes.  P's metadata goes in the pool_meta_size(PAGE_CNT)
+   bytes at META.  It covers all PAGE_CNT pages, with those
+   outside P marked used, so that P can later grow or shrink
+   within them; see pool_borrow(). */
+static void
+init_pool (struct pool *p, void *meta, uint8_t *base, size_t page_cnt,
+           size_t start, size_t end, const char *name)
+{
+    size_t bm_size = bitmap_buf_size (page_cnt);
+    size_t sum_size = bitmap_summary_buf_size (page_cnt);
 
     /* Initialize the pool. */
     lock_init (&p->lock);
-    p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-    p->base = base + bm_pages * PGSIZE;
+    p->used_map = bitmap_create_in_buf (page_cnt, meta, bm_size);
+    bitmap_set_multiple (p->used_map, 0, start, true);
+    bitmap_set_multiple (p->used_map, end, page_cnt - end, true);
+    bitmap_attach_summary (p->used_map, (uint8_t *) meta + bm_size, sum_size);
+    p->pages = (struct page *) ((uint8_t *) meta + bm_size + sum_size);
+    memset (p->pages, 0, page_cnt * sizeof (struct page));
+    p->base = base;
+    p->start = start;
+    p->end = end;
+    p->floor = (end - start) / 2;
+    p->ceiling = SIZE_MAX;
+    p->reserved = reserve_holes (p);
+
+    p->next_fit_start_idx = start;
+    p->mag.cnt = 0;
+    p->mag.zeroed_cnt = 0;
+    p->short_mag.cnt = 0;
+    p->short_mag.zeroed_cnt = 0;
+    p->policy = policies[PAL_FIRST_FIT];
+    rebuild_index (p);
+
+    printf ("%zu pages available in %s", end - start - p->reserved, name);
+    if (p->reserved > 0)
+        printf (", %zu more reserved by the BIOS", p->reserved);
+    printf (".\n");
+}
+
+/* Marks the pages of P that the BIOS memory map does not list
+   as usable RAM as used, for good, and returns how many there
+   are.  A page counts as usable only if it lies wholly inside a
+   usable range and overlaps no other range.  Without a memory
+   map, every page counts as usable. */
+static size_t
+reserve_holes (struct pool *p)
+{
+    uint64_t first_page = vtop (p->base) / PGSIZE;
+    size_t size = p->end - p->start;
+    int pass;
+    uint32_t i;
+
+    if (init_e820_cnt == 0)
+        return 0;
+
+    /* Mark everything reserved, free the usable ranges, and
+       then reserve whatever else overlaps them. */
+    bitmap_set_multiple (p->used_map, p->start, size, true);
+    for (pass = 0; pass < 2; pass++)
+        for (i = 0; i < init_e820_cnt; i++)
+          {
+            const struct e820_entry *e = &init_e820_map[i];
+            bool usable = e->type == E820_USABLE;
+            uint64_t lo, hi;
+
+            if (usable != (pass == 0))
+                continue;
+            if (usable)
+              {
+                lo = DIV_ROUND_UP (e->base, PGSIZE);
+                hi = (e->base + e->length) / PGSIZE;
+              }
+            else
+              {
+                lo = e->base / PGSIZE;
+                hi = DIV_ROUND_UP (e->base + e->length, PGSIZE);
+              }
+
+            /* Convert to page indexes and clip to P. */
+            lo = lo > first_page + p->start ? lo - first_page : p->start;
+            hi = hi > first_page + p->start ? hi - first_page : p->start;
+            if (hi > p->end)
+                hi = p->end;
+            if (lo < hi)
+                bitmap_set_multiple (p->used_map, lo, hi - lo, !usable);
+          }
+    return bitmap_count (p->used_map, p->start, size, true);
+}
+
+/* Moves whole chunks of free pages to POOL from the other pool,
+   enough for POOL to fit PAGE_CNT more contiguous pages if the
+   other pool can spare them.  The other pool keeps at least its
+   floor and POOL grows to at most its ceiling.  Returns true if
+   any pages moved.  Takes both pools' locks, in a fixed order, so
+   the caller must hold neither.
 
-    p->next_fit_start_idx = 0;
+   Pages move only across the boundary between the pools: the
+   kernel pool grows by taking the user pool's lowest pages, and
+   the user pool by taking the kernel pool's highest.  The pages
+   moved join the run of free pages that POOL already has at the
+   boundary, so only the shortfall between that run and PAGE_CNT
+   needs to move.  A chunk can move only if all of its pages are
+   free, so the lender's magazine is flushed first.  Both pools'
+   free block indexes are then rebuilt from used_map, which takes
+   time proportional to the size of memory, but happens only when
+   a pool runs out. */
+static bool
+pool_borrow (struct pool *pool, size_t page_cnt)
+{
+    struct pool *lender = pool == &kernel_pool ? &user_pool : &kernel_pool;
+    size_t moved = 0;
+    size_t edge, want, size, spare, first;
+
+    lock_acquire (&kernel_pool.lock);
+    lock_acquire (&user_pool.lock);
+
+    /* If the run at the boundary is already long enough, the
+       policy could not use it, so a single chunk is all that can
+       help. */
+    edge = boundary_run (pool, page_cnt);
+    want = ROUND_UP (edge < page_cnt ? page_cnt - edge : 1, CHUNK_PAGES);
+
+    /* The lender can spare its free pages, as long as it keeps
+       its floor.  Don't bother if that would not be enough. */
+    magazine_flush (lender);
+    size = lender->end - lender->start;
+    spare = size - bitmap_count (lender->used_map, lender->start, size,
+                                 true);
+    if (size < lender->floor)
+        spare = 0;
+    else if (spare > size - lender->floor)
+        spare = size - lender->floor;
+    if (want <= ROUND_DOWN (spare, CHUNK_PAGES)
+        && pool->end - pool->start + want <= pool->ceiling)
+      {
+        while (moved < want)
+          {
+            size_t chunk = (lender == &user_pool
+                            ? lender->start + moved
+                            : lender->end - moved - CHUNK_PAGES);
+
+            if (!bitmap_none (lender->used_map, chunk, CHUNK_PAGES))
+                break;
+            moved += CHUNK_PAGES;
+          }
+      }
+
+    if (moved > 0)
+      {
+        if (lender == &user_pool)
+          {
+            first = user_pool.start;
+            user_pool.start += moved;
+            kernel_pool.end += moved;
+          }
+        else
+          {
+            kernel_pool.end -= moved;
+            user_pool.start -= moved;
+            first = user_pool.start;
+          }
+        bitmap_set_multiple (lender->used_map, first, moved, true);
+        bitmap_set_multiple (pool->used_map, first, moved, false);
+        rebuild_index (lender);
+        rebuild_index (pool);
+
+        pool->borrows++;
+        pool->borrowed_pages += moved;
+        lender->loans++;
+        lender->lent_pages += moved;
+      }
+
+    lock_release (&user_pool.lock);
+    lock_release (&kernel_pool.lock);
+    return moved > 0;
+}
+
+/* Returns the number of free pages in POOL next to its boundary
+   with the other pool, counting no more than MAX.  POOL's lock
+   must be held. */
+static size_t
+boundary_run (struct pool *pool, size_t max)
+{
+    size_t cnt = 0;
+
+    if (pool == &kernel_pool)
+        while (cnt < max && pool->end - cnt > pool->start
+               && !bitmap_test (pool->used_map, pool->end - cnt - 1))
+            cnt++;
+    else
+      {
+        size_t used = bitmap_scan (pool->used_map, pool->start, 1, true);
+        cnt = (used == BITMAP_ERROR || used > pool->end
+               ? pool->end : used) - pool->start;
+        if (cnt > max)
+            cnt = max;
+      }
+    return cnt;
+}
+
+/* Returns the pool that PAGE belongs to, or a null pointer if
+   it is in neither pool. */
+static struct pool *
+pool_of (void *page)
+{
+    if (page_from_pool (&kernel_pool, page))
+        return &kernel_pool;
+    else if (page_from_pool (&user_pool, page))
+        return &user_pool;
+    else
+        return NULL;
 }
 
 /* Returns true if PAGE was allocated from POOL,
-   false otherwise. */
+   false otherwise.  POOL's bounds may be moving, but never past
+   an allocated page, so this needs no lock. */
 static bool
 page_from_pool (const struct pool *pool, void *page)
 {
     size_t page_no = pg_no (page);
-    size_t start_page = pg_no (pool->base);
-    size_t end_page = start_page + bitmap_size (pool->used_map);
+    size_t start_page = pg_no (pool->base) + pool->start;
+    size_t end_page = pg_no (pool->base) + pool->end;
 
     return page_no >= start_page && page_no < end_page;
 }
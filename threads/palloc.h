@@ -1,16 +1,173 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <list.h>
 #include <stddef.h>
 #include "threads/synch.h"
+#include "lib/kernel/avl.h"
 #include "lib/kernel/bitmap.h"
 
+/* Largest buddy block is 2**MAX_ORDER pages. */
 #define MAX_ORDER 10
+
+/* TLSF free lists: TLSF_SL_CNT second-level lists per power of
+   two, and enough first-level ranges for any 32-bit page count. */
+#define TLSF_SL_LOG2 3
+#define TLSF_SL_CNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_CNT (32 - TLSF_SL_LOG2 + 1)
+
+/* Contiguous allocation mode selector */
+enum palloc_mode {
+    PAL_FIRST_FIT,
+    PAL_NEXT_FIT,
+    PAL_BEST_FIT,
+    PAL_BUDDY,
+    PAL_TLSF
+};
+
+/* Number of palloc modes. */
+#define PAL_MODE_CNT (PAL_TLSF + 1)
+
+struct pool;
+
+/* A page allocation policy: how a pool finds and frees runs of
+   pages in one palloc mode.  Each pool has its own.  All of the
+   functions are called with the pool's lock held. */
+struct palloc_policy {
+    const char *name;                     /* Name, for statistics. */
+    enum palloc_mode mode;                /* Mode it implements. */
+
+    /* Allocates PAGE_CNT pages, optionally aligned on ALIGN
+       pages, and returns the index of the first one, or
+       BITMAP_ERROR. */
+    size_t (*alloc) (struct pool *, size_t page_cnt);
+    size_t (*alloc_aligned) (struct pool *, size_t page_cnt,
+                             size_t align);
+
+    /* Allocates the PAGE_CNT free pages at PAGE_IDX, which the
+       caller picked by looking at used_map. */
+    void (*claim) (struct pool *, size_t page_idx, size_t page_cnt);
+
+    /* Frees the PAGE_CNT pages at PAGE_IDX. */
+    void (*free) (struct pool *, size_t page_idx, size_t page_cnt);
+
+    /* Rebuilds the policy's free block index from the pool's
+       used_map, or null if it keeps none. */
+    void (*rebuild) (struct pool *);
+};
+
+/* Buckets in a log2 histogram of CPU cycles: bucket K counts
+   operations that took fewer than 2**(K+1) cycles, and the last
+   bucket also counts anything slower. */
+#define PAL_LAT_BUCKETS 24
+
+/* Cycle-timed latencies of one kind of pool operation. */
+struct palloc_latency {
+    unsigned long long cnt;               /* Operations timed. */
+    unsigned hist[PAL_LAT_BUCKETS];       /* Log2 histogram. */
+};
+
+/* Counters a pool keeps for each mode. */
+struct palloc_counters {
+    struct palloc_latency alloc;          /* Allocations. */
+    struct palloc_latency free;           /* Frees. */
+    unsigned long long failures;          /* Allocations that failed. */
+};
+
+/* Per-frame metadata.  A pool has one for each of its pages,
+   indexed like its used_map.  The free block indexes of the
+   buddy, best fit and TLSF modes are linked through these rather
+   than through the free pages themselves. */
+struct page {
+    union {
+        struct list_elem list_elem; /* Buddy or TLSF free list. */
+        struct avl_elem avl_elem;   /* Best fit extent tree. */
+    } free;
+    size_t length;                  /* Pages in allocation or extent. */
+    uint8_t order;                  /* Order of free buddy block. */
+    uint8_t flags;                  /* PG_* flags. */
+    uint8_t lifetime;               /* LT_* class of a pageblock,
+                                       in its first page. */
+};
+
+/* struct page flags. */
+#define PG_HEAD 0x01        /* First page of an allocation. */
+#define PG_BUDDY 0x02       /* First page of a free buddy block. */
+#define PG_EXTENT 0x04      /* First page of a free extent. */
+#define PG_EXTENT_TAIL 0x08 /* Last page of a free extent. */
+#define PG_CACHED 0x10      /* Free page held in a magazine. */
+
+/* Lifetime classes of pageblocks. */
+#define LT_ANY 0            /* Not set aside for a class. */
+#define LT_SHORT 1          /* For PAL_SHORTLIVED allocations. */
+#define LT_PINNED 2         /* For PAL_PINNED_LONG allocations. */
+
+/* A magazine is a small stack of free single pages that are
+   still marked allocated in their pool, so that single-page
+   allocations and frees need not take the pool's lock.  It is
+   refilled and drained MAG_BATCH pages at a time.  The idle
+   thread moves pages from it to a second stack of pages that it
+   has already zeroed, for PAL_ZERO requests.  Each pool has one
+   magazine for unclassed pages and one for short-lived pages. */
+#define MAG_SIZE 32         /* Most pages a magazine holds. */
+#define MAG_BATCH 16        /* Pages moved per refill or drain. */
+
+struct magazine {
+    size_t pages[MAG_SIZE];               /* Page indexes in pool. */
+    size_t cnt;                           /* Pages held. */
+    size_t zeroed[MAG_SIZE];              /* Zeroed page indexes. */
+    size_t zeroed_cnt;                    /* Zeroed pages held. */
+    unsigned long long get_hits;          /* Gets served from here. */
+    unsigned long long get_misses;        /* Gets that refilled. */
+    unsigned long long free_hits;         /* Frees kept here. */
+    unsigned long long free_misses;       /* Frees that drained. */
+    unsigned long long zero_gets;         /* PAL_ZERO single pages. */
+    unsigned long long zero_hits;         /* ...served pre-zeroed. */
+    unsigned long long idle_zeroed;       /* Pages zeroed when idle. */
+};
+
 struct pool {
     struct lock lock;
-    struct bitmap *used_map;
-    uint8_t *base;
+    struct bitmap *used_map;              /* Covers both pools. */
+    uint8_t *base;                        /* Page 0 of both pools. */
+    size_t start, end;                    /* Pages [START, END) are in
+                                             this pool. */
+    size_t floor;                         /* Fewest pages to keep when
+                                             lending to the other. */
+    size_t ceiling;                       /* Most pages to grow to by
+                                             borrowing. */
+    size_t reserved;                      /* Pages in the pool that
+                                             are not usable RAM. */
+    unsigned long long borrows;           /* Transfers in... */
+    unsigned long long borrowed_pages;    /* ...and pages they moved. */
+    unsigned long long loans;             /* Transfers out... */
+    unsigned long long lent_pages;        /* ...and pages they moved. */
+    unsigned long long shrinks;           /* Shrinker runs... */
+    unsigned long long shrunk_pages;      /* ...pages they reclaimed... */
+    unsigned long long shrink_rescues;    /* ...and allocations that
+                                             then succeeded. */
+    struct page *pages;                   /* Metadata for each page. */
+    const struct palloc_policy *policy;   /* Allocation policy. */
     size_t next_fit_start_idx;
+    struct magazine mag;                  /* Cached single pages. */
+    struct magazine short_mag;            /* ...short-lived ones. */
+    struct palloc_counters counters[PAL_MODE_CNT]; /* By mode. */
+
+    /* Best fit, valid only while the policy is PAL_BEST_FIT. */
+    struct avl extents;                   /* Free extents, by size. */
+
+    /* TLSF, valid only while the policy is PAL_TLSF. */
+    struct list tlsf_free[TLSF_FL_CNT][TLSF_SL_CNT]; /* Free extents. */
+    unsigned tlsf_fl_map;                 /* Bit F set if any list in
+                                             tlsf_free[F] is nonempty. */
+    unsigned tlsf_sl_map[TLSF_FL_CNT];    /* Bit S of element F set if
+                                             tlsf_free[F][S] is
+                                             nonempty. */
+
+    /* Buddy system, valid only while the policy is PAL_BUDDY. */
+    struct list free_area[MAX_ORDER + 1]; /* Free blocks, by order. */
+    unsigned free_area_mask;              /* Bit K set if free_area[K]
+                                             is nonempty. */
 };
 
 extern struct pool kernel_pool;
@@ -18,30 +175,101 @@ extern struct pool user_pool;
 
 /* How to allocate pages. */
 enum palloc_flags {
-    PAL_ASSERT = 001, /* Panic on failure. */
-    PAL_ZERO = 002,   /* Zero page contents. */
-    PAL_USER = 004    /* User page. */
+    PAL_ASSERT = 001,       /* Panic on failure. */
+    PAL_ZERO = 002,         /* Zero page contents. */
+    PAL_USER = 004,         /* User page. */
+    PAL_SHORTLIVED = 010,   /* Will be freed again soon. */
+    PAL_PINNED_LONG = 020   /* Will stay allocated for a long time. */
+};
+
+/* A shrinker gives back pages that some subsystem caches but
+   can do without.  When an allocation from a pool fails, the
+   page allocator calls the registered shrinkers, lowest PRIORITY
+   first, until they have given back enough pages, and then tries
+   the allocation once more. */
+struct shrinker {
+    const char *name;                     /* Name, for statistics. */
+    int priority;                         /* Lower is called first. */
+
+    /* Frees up to PAGE_CNT of the pages it caches from POOL and
+       returns the number it freed.  It is called with no pool
+       lock held, but possibly with any other lock held by the
+       thread that is allocating, so it must not allocate and
+       should only lock_try_acquire() its own locks, after
+       checking that the thread does not already hold them. */
+    size_t (*shrink) (struct pool *, size_t page_cnt);
+
+    unsigned long long calls;             /* Times called. */
+    unsigned long long reclaimed;         /* Pages it gave back. */
+    struct list_elem elem;                /* Element in shrinker list. */
 };
 
 void palloc_init(size_t user_page_limit);
 void *palloc_get_page(enum palloc_flags);
 void *palloc_get_multiple(enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned(enum palloc_flags, size_t page_cnt,
+                         size_t align_pages);
+size_t palloc_get_pages_batch(enum palloc_flags, size_t page_cnt,
+                              void **pages);
 void palloc_free_page(void *);
+void palloc_free_pages_batch(void **pages, size_t page_cnt);
 void palloc_free_multiple(void *, size_t page_cnt);
+void palloc_free(void *);
+bool palloc_resize(void *, size_t new_cnt);
 size_t palloc_get_page_index(void *page);
 void buddy_system_free (struct pool *pool, void *pages);
 size_t buddy_system_alloc (struct pool *pool, size_t page_cnt);
+size_t buddy_system_alloc_aligned (struct pool *pool, size_t page_cnt,
+                                   size_t align);
 size_t palloc_get_page_index(void *page);
 
 
+/* Buckets in a log2 histogram of free extent sizes: bucket K
+   counts extents of 2**K to 2**(K+1) - 1 pages, and the last
+   bucket also counts anything bigger. */
+#define PAL_HIST_CNT 16
 
-/* Contiguous allocation mode selector */
-enum palloc_mode {
-    PAL_FIRST_FIT,
-    PAL_NEXT_FIT,
-    PAL_BEST_FIT,
-    PAL_BUDDY
+/* A snapshot of one pool, filled in by palloc_stats(). */
+struct palloc_stats {
+    size_t free_pages;                    /* Pages free in the pool. */
+    size_t cached_pages;                  /* ...of them in magazine. */
+    size_t used_pages;                    /* Pages handed out. */
+    size_t reserved_pages;                /* Holes in RAM, never free. */
+    size_t largest_free;                  /* Largest free extent. */
+    size_t extent_cnt;                    /* Free extents. */
+    size_t extent_hist[PAL_HIST_CNT];     /* Free extents by size. */
+    size_t short_blocks;                  /* LT_SHORT pageblocks. */
+    size_t pinned_blocks;                 /* LT_PINNED pageblocks. */
+    unsigned long long borrows;           /* Transfers from the other
+                                             pool... */
+    unsigned long long borrowed_pages;    /* ...and pages they moved. */
+    unsigned long long loans;             /* Transfers to the other
+                                             pool... */
+    unsigned long long lent_pages;        /* ...and pages they moved. */
+    unsigned long long shrinks;           /* Shrinker runs... */
+    unsigned long long shrunk_pages;      /* ...pages they reclaimed... */
+    unsigned long long shrink_rescues;    /* ...and allocations that
+                                             then succeeded. */
+
+    /* Allocations and frees made by each mode, and their
+       latencies in cycles at the 50th, 90th and 99th percentiles,
+       rounded up to a power of two. */
+    struct {
+        unsigned long long allocs, frees, failures;
+        unsigned long long alloc_p50, alloc_p90, alloc_p99;
+        unsigned long long free_p50, free_p90, free_p99;
+    } modes[PAL_MODE_CNT];
 };
+
 void palloc_set_mode(enum palloc_mode mode);
+void palloc_set_pool_mode(struct pool *, enum palloc_mode mode);
+enum palloc_mode palloc_get_mode(const struct pool *);
+void palloc_set_floor(struct pool *, size_t page_cnt);
+void palloc_set_grouping(bool);
+void palloc_register_shrinker(struct shrinker *);
+void palloc_unregister_shrinker(struct shrinker *);
+void palloc_stats(struct pool *, struct palloc_stats *);
+void palloc_print_stats(void);
+bool palloc_zero_idle(void);
 
 #endif /* threads/palloc.h */
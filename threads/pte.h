@@ -55,7 +55,9 @@ pd_no(const void *va)
    |         Physical Address           |         Flags          |
    +------------------------------------+------------------------+
 
-   In a PDE, the physical address points to a page table.
+   In a PDE, the physical address points to a page table, or,
+   if PTE_PS is set, to a 4 MB data or code page, which must be
+   4 MB aligned.
    In a PTE, the physical address points to a data or code page.
    The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
@@ -70,6 +72,8 @@ pd_no(const void *va)
 #define PTE_U 0x4            /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20           /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40           /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80          /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100          /* 1=global, kept in TLB across CR3 loads. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t
@@ -85,9 +89,22 @@ static inline uint32_t *
 pde_get_pt(uint32_t pde)
 {
     ASSERT(pde & PTE_P);
+    ASSERT(!(pde & PTE_PS));
     return ptov(pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the 4 MB page at PAGE directly.
+   The page is readable.
+   If WRITABLE is true then it will be writable as well.
+   The page will be usable only by ring 0 code (the kernel).
+   CR4.PSE must be set for the CPU to honor it. */
+static inline uint32_t
+pde_create_large(void *page, bool writable)
+{
+    ASSERT(((uintptr_t)page & (PTSPAN - 1)) == 0);
+    return vtop(page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
@@ -0,0 +1,430 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab object caches.
+
+   A cache hands out objects of one fixed size, carved out of
+   "slabs": runs of 2**K pages from palloc_get_aligned(), aligned
+   on their own size, so that an object's slab is found by
+   rounding its address down.  A slab starts with a struct slab
+   header and keeps its free objects on a singly linked list, so
+   allocating and freeing an object are a pointer pop and push.
+
+   Each cache keeps its slabs on three lists: partial slabs,
+   which have both free and allocated objects, full slabs and
+   empty slabs.  Allocations come from a partial slab if there
+   is one, so that objects stay packed into as few slabs as
+   possible, then from an empty slab, and only then from a new
+   one.  Empty slabs stay with the cache until the page allocator
+   runs short of pages and its shrinker takes them back.
+
+   A cache may have a constructor, which is run on each object
+   once, when its slab is created, rather than on every
+   allocation.  A freed object must be returned in its
+   constructed state, and the free list link is kept after the
+   object's bytes, so that the state survives until the object is
+   allocated again.
+
+   Objects start at a different offset in each new slab, cycling
+   through as many multiples of the cache line size as the
+   space left over at the end of a slab allows.  This "colouring"
+   keeps the first objects of every slab from competing for the
+   same cache lines. */
+
+/* Most pages in a slab. */
+#define SLAB_MAX_PAGES 16
+
+/* Fewest objects a slab should hold, if SLAB_MAX_PAGES allows. */
+#define SLAB_MIN_OBJS 8
+
+/* Bytes in a CPU cache line, the step between slab colours. */
+#define CACHE_LINE 64
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0bec
+
+/* Cache. */
+struct kmem_cache {
+    char name[16];              /* Name, for statistics. */
+    size_t size;                /* Object size requested. */
+    size_t stride;              /* Bytes from one object to the next. */
+    size_t link_ofs;            /* Offset of free list link in object. */
+    size_t slab_pages;          /* Pages per slab, a power of 2. */
+    size_t objs_per_slab;       /* Objects in each slab. */
+    size_t first_ofs;           /* Offset of first object in colour 0. */
+    size_t colour_step;         /* Bytes between colours. */
+    size_t colour_cnt;          /* Number of colours. */
+    size_t colour_next;         /* Colour of the next new slab. */
+    void (*ctor)(void *);       /* Constructor, or null. */
+
+    struct lock lock;           /* Protects everything below. */
+    struct list partial;        /* Slabs with some objects free. */
+    struct list full;           /* Slabs with no objects free. */
+    struct list empty;          /* Slabs with all objects free. */
+    size_t in_use;              /* Objects allocated. */
+    size_t slab_cnt;            /* Slabs on all three lists. */
+    size_t ctor_calls;          /* Objects constructed. */
+    struct list_elem elem;      /* Element in caches. */
+};
+
+/* Slab header, at the start of the slab's first page. */
+struct slab {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    uint8_t *objs;              /* First object, after colouring. */
+    void *free;                 /* First free object, or null. */
+    size_t in_use;              /* Objects allocated. */
+};
+
+/* All caches. */
+static struct list caches;
+static struct lock caches_lock;
+
+static void cache_snapshot(struct kmem_cache *, struct kmem_cache_stats *);
+static struct slab *slab_create(struct kmem_cache *);
+static void slab_destroy(struct slab *);
+static struct slab *obj_to_slab(struct kmem_cache *, void *);
+static size_t shrink_empty_slabs(struct pool *, size_t page_cnt);
+
+/* Gives empty slabs back to the page allocator.  Constructing
+   their objects again costs more than rebuilding a malloc()
+   arena, so it runs after malloc()'s shrinker. */
+static struct shrinker slab_shrinker = {
+    .name = "empty slabs",
+    .priority = 10,
+    .shrink = shrink_empty_slabs,
+};
+
+/* Initializes the slab allocator.  Must be called after
+   malloc_init(). */
+void slab_init(void)
+{
+    list_init(&caches);
+    lock_init(&caches_lock);
+    palloc_register_shrinker(&slab_shrinker);
+}
+
+/* Creates and returns a cache of SIZE-byte objects, aligned on
+   ALIGN bytes, which must be a power of 2, or 0 for the
+   alignment of a pointer.  If CTOR is nonnull, it is called on
+   each object once, when the slab holding it is created; it must
+   not allocate from the cache itself.  Returns a null pointer if
+   memory is not available or an object cannot fit in a slab. */
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+                  void (*ctor)(void *))
+{
+    struct kmem_cache *c;
+    size_t leftover;
+
+    if (align < sizeof(void *))
+        align = sizeof(void *);
+    ASSERT((align & (align - 1)) == 0);
+    if (size == 0)
+        return NULL;
+
+    c = malloc(sizeof *c);
+    if (c == NULL)
+        return NULL;
+    strlcpy(c->name, name, sizeof c->name);
+    c->size = size;
+    c->ctor = ctor;
+
+    /* Without a constructor, a free object's bytes are all
+       unused, so the link goes at the start. */
+    if (ctor != NULL) {
+        c->link_ofs = ROUND_UP(size, sizeof(void *));
+        c->stride = ROUND_UP(c->link_ofs + sizeof(void *), align);
+    } else {
+        c->link_ofs = 0;
+        c->stride = ROUND_UP(size < sizeof(void *) ? sizeof(void *) : size,
+                             align);
+    }
+
+    /* Use the smallest slab that holds SLAB_MIN_OBJS objects. */
+    c->first_ofs = ROUND_UP(sizeof(struct slab), align);
+    for (c->slab_pages = 1;; c->slab_pages *= 2) {
+        size_t slab_size = c->slab_pages * PGSIZE;
+
+        c->objs_per_slab = c->first_ofs < slab_size
+                               ? (slab_size - c->first_ofs) / c->stride
+                               : 0;
+        if (c->objs_per_slab >= SLAB_MIN_OBJS
+            || c->slab_pages == SLAB_MAX_PAGES)
+            break;
+    }
+    if (c->objs_per_slab == 0) {
+        free(c);
+        return NULL;
+    }
+
+    leftover = (c->slab_pages * PGSIZE - c->first_ofs
+                - c->objs_per_slab * c->stride);
+    c->colour_step = align > CACHE_LINE ? align : CACHE_LINE;
+    c->colour_cnt = leftover / c->colour_step + 1;
+    c->colour_next = 0;
+
+    lock_init(&c->lock);
+    list_init(&c->partial);
+    list_init(&c->full);
+    list_init(&c->empty);
+    c->in_use = 0;
+    c->slab_cnt = 0;
+    c->ctor_calls = 0;
+
+    lock_acquire(&caches_lock);
+    list_push_back(&caches, &c->elem);
+    lock_release(&caches_lock);
+    return c;
+}
+
+/* Destroys cache C, which must have no objects allocated, and
+   gives its slabs back to the page allocator. */
+void kmem_cache_destroy(struct kmem_cache *c)
+{
+    if (c == NULL)
+        return;
+    ASSERT(c->in_use == 0);
+
+    lock_acquire(&caches_lock);
+    list_remove(&c->elem);
+    lock_release(&caches_lock);
+
+    while (!list_empty(&c->empty))
+        slab_destroy(list_entry(list_pop_front(&c->empty), struct slab, elem));
+    ASSERT(list_empty(&c->partial) && list_empty(&c->full));
+    free(c);
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+    struct slab *s;
+    void *obj;
+
+    lock_acquire(&c->lock);
+
+    /* Find a slab with a free object, making one if need be. */
+    if (!list_empty(&c->partial))
+        s = list_entry(list_front(&c->partial), struct slab, elem);
+    else if (!list_empty(&c->empty)) {
+        s = list_entry(list_pop_front(&c->empty), struct slab, elem);
+        list_push_front(&c->partial, &s->elem);
+    } else {
+        s = slab_create(c);
+        if (s == NULL) {
+            lock_release(&c->lock);
+            return NULL;
+        }
+        list_push_front(&c->partial, &s->elem);
+    }
+
+    /* Pop an object off its free list. */
+    obj = s->free;
+    s->free = *(void **)((uint8_t *)obj + c->link_ofs);
+    s->in_use++;
+    c->in_use++;
+    if (s->free == NULL) {
+        list_remove(&s->elem);
+        list_push_back(&c->full, &s->elem);
+    }
+
+    lock_release(&c->lock);
+    return obj;
+}
+
+/* Frees OBJ, which must have been allocated from cache C and,
+   if C has a constructor, must be in its constructed state. */
+void kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+    struct slab *s;
+
+    if (obj == NULL)
+        return;
+    s = obj_to_slab(c, obj);
+
+#ifndef NDEBUG
+    /* Clear the object to help detect use-after-free bugs. */
+    if (c->ctor == NULL)
+        memset(obj, 0xcc, c->size);
+#endif
+
+    lock_acquire(&c->lock);
+
+    /* Push it onto its slab's free list. */
+    *(void **)((uint8_t *)obj + c->link_ofs) = s->free;
+    s->free = obj;
+    c->in_use--;
+
+    /* Move the slab to the list it now belongs on. */
+    if (--s->in_use == 0) {
+        list_remove(&s->elem);
+        list_push_front(&c->empty, &s->elem);
+    } else if (s->in_use == c->objs_per_slab - 1) {
+        list_remove(&s->elem);
+        list_push_front(&c->partial, &s->elem);
+    }
+
+    lock_release(&c->lock);
+}
+
+/* Fills in ST with a snapshot of cache C. */
+void kmem_cache_stats(struct kmem_cache *c, struct kmem_cache_stats *st)
+{
+    lock_acquire(&c->lock);
+    cache_snapshot(c, st);
+    lock_release(&c->lock);
+}
+
+/* Fills in ST with a snapshot of cache C.  Either C's lock must
+   be held or interrupts must be off. */
+static void
+cache_snapshot(struct kmem_cache *c, struct kmem_cache_stats *st)
+{
+    st->obj_size = c->stride;
+    st->objs_per_slab = c->objs_per_slab;
+    st->slab_pages = c->slab_pages;
+    st->in_use = c->in_use;
+    st->total = c->slab_cnt * c->objs_per_slab;
+    st->full_slabs = list_size(&c->full);
+    st->partial_slabs = list_size(&c->partial);
+    st->empty_slabs = list_size(&c->empty);
+    st->ctor_calls = c->ctor_calls;
+}
+
+/* Prints the occupancy of every cache.  This runs on the panic
+   path, where caches_lock or a cache's lock may be held by the
+   thread that panicked, so it reads the caches with interrupts
+   off instead of locking. */
+void slab_print_stats(void)
+{
+    struct list_elem *e;
+    enum intr_level old_level;
+
+    old_level = intr_disable();
+    for (e = list_begin(&caches); e != list_end(&caches); e = list_next(e)) {
+        struct kmem_cache *c = list_entry(e, struct kmem_cache, elem);
+        struct kmem_cache_stats st;
+
+        cache_snapshot(c, &st);
+        printf("Slab: %s: %zu of %zu %zu-byte objects in use, "
+               "%zu %zu-page slabs (%zu full, %zu partial, %zu empty)\n",
+               c->name, st.in_use, st.total, st.obj_size,
+               st.full_slabs + st.partial_slabs + st.empty_slabs,
+               st.slab_pages, st.full_slabs, st.partial_slabs,
+               st.empty_slabs);
+    }
+    intr_set_level(old_level);
+}
+
+/* Allocates a new slab for cache C, constructs its objects and
+   returns it, or returns a null pointer if memory is not
+   available.  C's lock must be held. */
+static struct slab *
+slab_create(struct kmem_cache *c)
+{
+    struct slab *s;
+    uint8_t *obj;
+    size_t i;
+
+    s = palloc_get_aligned(0, c->slab_pages, c->slab_pages);
+    if (s == NULL)
+        return NULL;
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->in_use = 0;
+
+    /* Link the objects in address order, last first. */
+    s->objs = (uint8_t *)s + c->first_ofs + c->colour_next * c->colour_step;
+    s->free = NULL;
+    obj = s->objs + (c->objs_per_slab - 1) * c->stride;
+    for (i = 0; i < c->objs_per_slab; i++, obj -= c->stride) {
+        if (c->ctor != NULL)
+            c->ctor(obj);
+        *(void **)(obj + c->link_ofs) = s->free;
+        s->free = obj;
+    }
+    if (c->ctor != NULL)
+        c->ctor_calls += c->objs_per_slab;
+
+    if (++c->colour_next >= c->colour_cnt)
+        c->colour_next = 0;
+    c->slab_cnt++;
+    return s;
+}
+
+/* Gives slab S, which must have no objects allocated and must
+   not be on any list, back to the page allocator.  S's cache's
+   lock must be held, or the cache must be private to the
+   caller. */
+static void
+slab_destroy(struct slab *s)
+{
+    struct kmem_cache *c = s->cache;
+
+    ASSERT(s->magic == SLAB_MAGIC);
+    ASSERT(s->in_use == 0);
+    c->slab_cnt--;
+    palloc_free_multiple(s, c->slab_pages);
+}
+
+/* Returns the slab of cache C that OBJ is inside. */
+static struct slab *
+obj_to_slab(struct kmem_cache *c, void *obj)
+{
+    struct slab *s = (struct slab *)ROUND_DOWN((uintptr_t)obj,
+                                               c->slab_pages * PGSIZE);
+
+    /* Check that the slab is valid and the object lies on an
+       object boundary within it. */
+    ASSERT(s->magic == SLAB_MAGIC);
+    ASSERT(s->cache == c);
+    ASSERT((uint8_t *)obj >= s->objs);
+    ASSERT(((uint8_t *)obj - s->objs) % c->stride == 0);
+
+    return s;
+}
+
+/* Frees empty slabs, up to PAGE_CNT pages' worth, if POOL is the
+   kernel pool, and returns the number of pages freed.  Skips
+   caches whose lock is held, since the allocation that ran out
+   of pages may have been made with it held. */
+static size_t
+shrink_empty_slabs(struct pool *pool, size_t page_cnt)
+{
+    struct list_elem *e;
+    size_t freed = 0;
+
+    if (pool != &kernel_pool || lock_held_by_current_thread(&caches_lock)
+        || !lock_try_acquire(&caches_lock))
+        return 0;
+    for (e = list_begin(&caches); e != list_end(&caches) && freed < page_cnt;
+         e = list_next(e)) {
+        struct kmem_cache *c = list_entry(e, struct kmem_cache, elem);
+
+        if (lock_held_by_current_thread(&c->lock)
+            || !lock_try_acquire(&c->lock))
+            continue;
+        while (!list_empty(&c->empty) && freed < page_cnt) {
+            struct list_elem *se = list_pop_front(&c->empty);
+            slab_destroy(list_entry(se, struct slab, elem));
+            freed += c->slab_pages;
+        }
+        lock_release(&c->lock);
+    }
+    lock_release(&caches_lock);
+    return freed;
+}
@@ -0,0 +1,30 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+struct kmem_cache;
+
+/* A snapshot of one cache, filled in by kmem_cache_stats(). */
+struct kmem_cache_stats {
+    size_t obj_size;       /* Bytes per object, padding included. */
+    size_t objs_per_slab;  /* Objects in each slab. */
+    size_t slab_pages;     /* Pages in each slab. */
+    size_t in_use;         /* Objects allocated. */
+    size_t total;          /* Objects in all slabs. */
+    size_t full_slabs;     /* Slabs with no free object. */
+    size_t partial_slabs;  /* Slabs with some free objects. */
+    size_t empty_slabs;    /* Slabs with no allocated object. */
+    size_t ctor_calls;     /* Objects constructed. */
+};
+
+void slab_init(void);
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+                                     size_t align, void (*ctor)(void *));
+void kmem_cache_destroy(struct kmem_cache *);
+void *kmem_cache_alloc(struct kmem_cache *) __attribute__((malloc));
+void kmem_cache_free(struct kmem_cache *, void *);
+void kmem_cache_stats(struct kmem_cache *, struct kmem_cache_stats *);
+void slab_print_stats(void);
+
+#endif /* threads/slab.h */
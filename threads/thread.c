@@ -165,7 +165,7 @@ tid_t thread_create(const char *name, int priority,
     ASSERT(function != NULL);
 
     /* Allocate thread. */
-    t = palloc_get_page(PAL_ZERO);
+    t = palloc_get_page(PAL_ZERO | PAL_SHORTLIVED);
     if (t == NULL)
         return TID_ERROR;
 
@@ -275,7 +275,8 @@ void thread_exit(void)
 {
     ASSERT(!intr_context());
 
-
+    /* Give the blocks this thread kept back to malloc(). */
+    malloc_flush();
 
     /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -375,6 +376,11 @@ idle(void *idle_started_ UNUSED)
     sema_up(idle_started);
 
     for (;;) {
+        /* Zero free pages for PAL_ZERO requests until someone else
+           is ready to run or there are none left to zero. */
+        while (list_empty(&ready_list) && palloc_zero_idle())
+            continue;
+
         /* Let someone else run. */
         intr_disable();
         thread_block();
@@ -4,6 +4,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/malloc.h"
 
 /* States in a thread's life cycle. */
 enum thread_status {
@@ -91,6 +92,8 @@ struct thread {
     /* Shared between thread.c and synch.c. */
     struct list_elem elem; /* List element. */
 
+    /* Owned by malloc.c. */
+    struct malloc_cache malloc_cache; /* Free blocks kept for reuse. */
 
 
     /* Owned by thread.c. */
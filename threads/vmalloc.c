@@ -0,0 +1,197 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Virtually contiguous kernel allocations.
+
+   palloc_get_multiple() needs a run of physically contiguous
+   free pages, which may not exist once the kernel pool is
+   fragmented, even with plenty of single pages free.  Most large
+   kernel buffers only need to be contiguous in virtual memory,
+   so vmalloc() builds them out of single pages from
+   palloc_get_page(), mapped side by side in a region of kernel
+   virtual memory of its own.
+
+   The region starts at the first page directory entry above the
+   direct mapping of physical memory set up by paging_init().
+   Its page tables are all allocated and installed in
+   init_page_dir by vmalloc_init(), so that page directory
+   entries never change afterward.  A bitmap records which of
+   its pages are in use.
+
+   Each allocation is followed by an unmapped guard page, which
+   is reserved along with it.  Running off the end of a buffer
+   then faults instead of corrupting the next one, and vfree()
+   finds the end of an allocation by looking for the guard page.
+
+   Memory from vmalloc() is not physically contiguous, so vtop()
+   does not work on it.  It is slower to set up and tear down
+   than memory from palloc_get_multiple(), since every page needs
+   a frame and a mapping of its own. */
+
+/* Frames that vmalloc() and vfree() get or free at a time. */
+#define FRAME_BATCH 16
+
+static uint8_t *vmalloc_start; /* First page of the region. */
+static size_t vmalloc_pages;   /* Pages in the region. */
+static struct bitmap *used_map; /* Pages in use, guard pages included. */
+static struct lock vmalloc_lock; /* Protects used_map. */
+
+static size_t unmap_pages(uint8_t *vaddr);
+static void release_pages(uint8_t *vaddr, size_t page_cnt);
+static uint32_t *lookup_pte(const void *);
+static void invalidate(const void *);
+
+/* Sets up the vmalloc region above the direct mapping.  Must be
+   called after paging_init() and malloc_init(). */
+void vmalloc_init(void)
+{
+    uintptr_t start = ROUND_UP(init_ram_pages * PGSIZE, PTSPAN);
+    uintptr_t room = (uintptr_t)0 - ((uintptr_t)PHYS_BASE + start);
+    uint32_t *pts[VMALLOC_PAGES / (PTSPAN / PGSIZE)];
+    size_t i;
+
+    vmalloc_start = ptov(start);
+    vmalloc_pages = VMALLOC_PAGES;
+    if (room / PGSIZE < vmalloc_pages)
+        vmalloc_pages = ROUND_DOWN(room / PGSIZE, PTSPAN / PGSIZE);
+    used_map = bitmap_create(vmalloc_pages);
+    if (used_map == NULL)
+        PANIC("vmalloc_init: out of memory");
+    lock_init(&vmalloc_lock);
+
+    palloc_get_pages_batch(PAL_ASSERT | PAL_ZERO | PAL_PINNED_LONG,
+                           vmalloc_pages / (PTSPAN / PGSIZE), (void **)pts);
+    for (i = 0; i < vmalloc_pages / (PTSPAN / PGSIZE); i++)
+        init_page_dir[pd_no(vmalloc_start + i * PTSPAN)] = pde_create(pts[i]);
+}
+
+/* Obtains and returns SIZE bytes of virtually contiguous memory,
+   rounded up to a whole number of pages, starting on a page
+   boundary.  Returns a null pointer if there is not enough free
+   virtual address space or memory. */
+void *
+vmalloc(size_t size)
+{
+    size_t page_cnt = DIV_ROUND_UP(size, PGSIZE);
+    size_t page_idx, i, cnt;
+    uint8_t *vaddr;
+
+    if (page_cnt == 0 || page_cnt >= vmalloc_pages)
+        return NULL;
+
+    /* Reserve the pages and a guard page after them. */
+    lock_acquire(&vmalloc_lock);
+    page_idx = bitmap_scan_and_flip(used_map, 0, page_cnt + 1, false);
+    lock_release(&vmalloc_lock);
+    if (page_idx == BITMAP_ERROR)
+        return NULL;
+    vaddr = vmalloc_start + page_idx * PGSIZE;
+
+    /* Back each page with a frame of its own, getting the frames
+       FRAME_BATCH at a time. */
+    for (i = 0; i < page_cnt; i += cnt) {
+        void *frames[FRAME_BATCH];
+        size_t want = page_cnt - i < FRAME_BATCH ? page_cnt - i : FRAME_BATCH;
+        size_t j;
+
+        cnt = palloc_get_pages_batch(0, want, frames);
+        for (j = 0; j < cnt; j++)
+            *lookup_pte(vaddr + (i + j) * PGSIZE) =
+                pte_create_kernel(frames[j], true);
+        if (cnt < want) {
+            unmap_pages(vaddr);
+            release_pages(vaddr, page_cnt + 1);
+            return NULL;
+        }
+    }
+    return vaddr;
+}
+
+/* Frees memory P, which must have been obtained from vmalloc(). */
+void vfree(void *p)
+{
+    size_t page_cnt;
+
+    if (p == NULL)
+        return;
+    ASSERT(is_vmalloc_addr(p));
+    ASSERT(pg_ofs(p) == 0);
+
+    page_cnt = unmap_pages(p);
+    release_pages(p, page_cnt + 1);
+}
+
+/* Returns true if P lies in the vmalloc region. */
+bool is_vmalloc_addr(const void *p)
+{
+    const uint8_t *vaddr = p;
+    return (vmalloc_start != NULL && vaddr >= vmalloc_start
+            && vaddr < vmalloc_start + vmalloc_pages * PGSIZE);
+}
+
+/* Unmaps the pages starting at VADDR, up to the first page that
+   is not mapped, and frees the frames behind them, FRAME_BATCH at
+   a time.  Returns the number of pages unmapped. */
+static size_t
+unmap_pages(uint8_t *vaddr)
+{
+    void *frames[FRAME_BATCH];
+    size_t page_cnt, frame_cnt = 0;
+
+    for (page_cnt = 0;; page_cnt++) {
+        uint8_t *page = vaddr + page_cnt * PGSIZE;
+        uint32_t *pte = lookup_pte(page);
+
+        if (!(*pte & PTE_P))
+            break;
+        frames[frame_cnt++] = pte_get_page(*pte);
+        *pte = 0;
+        invalidate(page);
+        if (frame_cnt == FRAME_BATCH) {
+            palloc_free_pages_batch(frames, frame_cnt);
+            frame_cnt = 0;
+        }
+    }
+    palloc_free_pages_batch(frames, frame_cnt);
+    return page_cnt;
+}
+
+/* Returns the PAGE_CNT pages of virtual address space starting
+   at VADDR to the vmalloc region. */
+static void
+release_pages(uint8_t *vaddr, size_t page_cnt)
+{
+    size_t page_idx = pg_no(vaddr) - pg_no(vmalloc_start);
+
+    lock_acquire(&vmalloc_lock);
+    ASSERT(bitmap_all(used_map, page_idx, page_cnt));
+    bitmap_set_multiple(used_map, page_idx, page_cnt, false);
+    lock_release(&vmalloc_lock);
+}
+
+/* Returns the page table entry for page VADDR of the vmalloc
+   region. */
+static uint32_t *
+lookup_pte(const void *vaddr)
+{
+    ASSERT(is_vmalloc_addr(vaddr));
+    return &pde_get_pt(init_page_dir[pd_no(vaddr)])[pt_no(vaddr)];
+}
+
+/* Flushes VADDR's translation from the TLB.  See [IA32-v2a]
+   "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate(const void *vaddr)
+{
+    asm volatile("invlpg (%0)" : : "r"(vaddr) : "memory");
+}
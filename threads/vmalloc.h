@@ -0,0 +1,17 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Size of the vmalloc region, in pages.  16 MB.  main() keeps
+   this much of the kernel's virtual address space clear of the
+   direct mapping of RAM. */
+#define VMALLOC_PAGES 4096
+
+void vmalloc_init(void);
+void *vmalloc(size_t size) __attribute__((malloc));
+void vfree(void *);
+bool is_vmalloc_addr(const void *);
+
+#endif /* threads/vmalloc.h */